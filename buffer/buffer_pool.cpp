@@ -0,0 +1,58 @@
+#include "buffer_pool.h"
+#include "../threadpool/thread_affinity.h"
+
+buffer_pool::~buffer_pool(){
+    for(int n = 0; n < MAX_NODES; ++n){
+        for(int i = 0; i <= MAX_SHIFT - MIN_SHIFT; ++i){
+            for(size_t j = 0; j < m_classes[n][i].free_list.size(); ++j)
+                delete[] m_classes[n][i].free_list[j];
+        }
+    }
+}
+
+int buffer_pool::node_index(){
+    int node = thread_node();
+    if(node < 0)
+        return 0;
+    return node < MAX_NODES ? node : MAX_NODES - 1;
+}
+
+// 能容纳size的最小级别
+int buffer_pool::class_index(int size){
+    int idx = 0;
+    while((1 << (MIN_SHIFT + idx)) < size)
+        ++idx;
+    return idx;
+}
+
+char* buffer_pool::alloc(int size, int &cap){
+    if(size > MAX_SIZE)
+        return nullptr;
+    int idx = class_index(size);
+    cap = 1 << (MIN_SHIFT + idx);
+
+    size_class &sc = m_classes[node_index()][idx];
+    sc.lock.lock();
+    if(!sc.free_list.empty()){
+        char *buf = sc.free_list.back();
+        sc.free_list.pop_back();
+        sc.lock.unlock();
+        return buf;
+    }
+    sc.lock.unlock();
+    return new char[cap];
+}
+
+void buffer_pool::free(char *buf, int cap){
+    if(!buf)
+        return;
+    int idx = class_index(cap);
+    size_class &sc = m_classes[node_index()][idx];
+    sc.lock.lock();
+    if((int)sc.free_list.size() < MAX_FREE_BYTES / cap){
+        sc.free_list.push_back(buf);
+        buf = nullptr;
+    }
+    sc.lock.unlock();
+    delete[] buf;
+}
@@ -0,0 +1,48 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <vector>
+
+#include "../locker/locker.h"
+
+using namespace std;
+
+// 按2的幂分级的缓冲区池，连接按需取用读写缓冲，空闲时归还
+// 每个NUMA节点每级一个空闲链表和一把锁，归还的块留给同一节点上的下一个连接复用，超过上限的直接释放
+// 新块由取用的线程首次写入，绑核后按首次访问落在该线程所在节点
+class buffer_pool{
+public:
+    static buffer_pool* get_instance(){
+        static buffer_pool instance;
+        return &instance;
+    }
+
+    static const int MIN_SHIFT = 10;                    // 最小1KB
+    static const int MAX_SHIFT = 16;                    // 最大64KB
+    static const int MAX_SIZE = 1 << MAX_SHIFT;
+    static const int MAX_FREE_BYTES = 4 << 20;          // 每个节点每级最多缓存的空闲字节数
+    static const int MAX_NODES = 8;                     // 超出的节点与最后一个共用空闲链表
+
+    // 取容量不小于size的缓冲区，cap返回实际容量，超过最大级别返回nullptr
+    char* alloc(int size, int &cap);
+    // 归还缓冲区，cap必须是alloc返回的容量
+    void free(char *buf, int cap);
+
+private:
+    buffer_pool(){}
+    ~buffer_pool();
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    static int class_index(int size);
+    // 当前线程所在节点的空闲链表，未绑核的线程使用节点0
+    static int node_index();
+
+    struct size_class{
+        mutexlocker lock;
+        vector<char*> free_list;
+    };
+    size_class m_classes[MAX_NODES][MAX_SHIFT - MIN_SHIFT + 1];
+};
+
+#endif
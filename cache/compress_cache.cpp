@@ -0,0 +1,233 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <zlib.h>
+#include <brotli/encode.h>
+
+#include "compress_cache.h"
+#include "../log/log.h"
+#include "../threadpool/thread_affinity.h"
+
+const char *encoding_names[ENC_NUM] = {"br", "zstd", "gzip"};
+const char *encoding_exts[ENC_NUM] = {".br", ".zst", ".gz"};
+
+int parse_accept_encoding(const char *value, int len){
+    int mask = 0;
+    const char *end = value + len;
+    const char *p = value;
+    while(p < end){
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            ++p;
+        const char *tok = p;
+        while(p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            ++p;
+        int tok_len = p - tok;
+        // q值，只关心是否为0
+        bool zero = false;
+        while(p < end && *p != ','){
+            if(*p == 'q' && p + 1 < end && p[1] == '='){
+                double q = strtod(p + 2, nullptr);
+                zero = q <= 0;
+            }
+            ++p;
+        }
+        if(zero || tok_len == 0)
+            continue;
+        for(int i = 0; i < ENC_NUM; ++i){
+            if(tok_len == (int)strlen(encoding_names[i]) && strncasecmp(tok, encoding_names[i], tok_len) == 0)
+                mask |= 1 << i;
+        }
+        if(tok_len == 1 && *tok == '*')
+            mask |= (1 << ENC_NUM) - 1;
+    }
+    return mask;
+}
+
+bool compressible(const char *mime){
+    return strncmp(mime, "text/", 5) == 0 || strcmp(mime, "application/javascript") == 0 ||
+           strcmp(mime, "application/json") == 0 || strcmp(mime, "application/xml") == 0 ||
+           strcmp(mime, "image/svg+xml") == 0;
+}
+
+compress_cache::compress_cache(){
+    m_budget = 0;
+    m_cur_bytes = 0;
+    m_min_size = 0;
+    m_max_size = 0;
+    m_enabled = false;
+    m_close_log = 0;
+}
+
+compress_cache::~compress_cache(){
+}
+
+bool compress_cache::init(size_t budget, size_t min_size, size_t max_size, int close_log){
+    m_budget = budget;
+    m_min_size = min_size;
+    m_max_size = max_size;
+    m_close_log = close_log;
+
+    pthread_t tid;
+    if(pthread_create(&tid, nullptr, worker, this) != 0){
+        LOG_ERROR("%s", "compress thread create failure, compression disabled");
+        return false;
+    }
+    pthread_detach(tid);
+    m_enabled = true;
+    return true;
+}
+
+bool compress_cache::can_compress(ENCODING enc){
+    return enc == ENC_BR || enc == ENC_GZIP;
+}
+
+string compress_cache::make_key(const char *path, const struct stat &st, ENCODING enc){
+    char buf[64];
+    snprintf(buf, sizeof(buf), "|%lx|%llx|%d", (unsigned long)st.st_mtime, (unsigned long long)st.st_size, enc);
+    return string(path) + buf;
+}
+
+shared_ptr<const compressed_entry> compress_cache::get(const char *path, const struct stat &st, ENCODING enc){
+    if(!m_enabled)
+        return nullptr;
+    string key = make_key(path, st, enc);
+    m_lock.lock();
+    unordered_map<string, lru_list::iterator>::iterator it = m_map.find(key);
+    if(it == m_map.end()){
+        m_lock.unlock();
+        return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    shared_ptr<const compressed_entry> entry = *it->second;
+    m_lock.unlock();
+    return entry;
+}
+
+void compress_cache::submit(const char *path, const struct stat &st, ENCODING enc){
+    if(!m_enabled || !can_compress(enc))
+        return;
+    job j;
+    j.key = make_key(path, st, enc);
+    j.path = path;
+    j.mtime = st.st_mtime;
+    j.size = st.st_size;
+    j.enc = enc;
+    m_lock.lock();
+    if(m_jobs.size() >= MAX_PENDING || m_pending.count(j.key) || m_map.count(j.key)){
+        m_lock.unlock();
+        return;
+    }
+    m_pending.insert(j.key);
+    m_jobs.push_back(j);
+    m_cond.signal();
+    m_lock.unlock();
+}
+
+static bool gzip_compress(const string &src, string &dst){
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15+16输出gzip格式
+    if(deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    dst.resize(deflateBound(&zs, src.size()));
+    zs.next_in = (Bytef *)src.data();
+    zs.avail_in = src.size();
+    zs.next_out = (Bytef *)&dst[0];
+    zs.avail_out = dst.size();
+    int ret = deflate(&zs, Z_FINISH);
+    dst.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+static bool brotli_compress(const string &src, string &dst){
+    size_t out_len = BrotliEncoderMaxCompressedSize(src.size());
+    if(out_len == 0)
+        return false;
+    dst.resize(out_len);
+    // 质量5在压缩率与速度间折中
+    if(!BrotliEncoderCompress(5, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, src.size(),
+                              (const uint8_t *)src.data(), &out_len, (uint8_t *)&dst[0]))
+        return false;
+    dst.resize(out_len);
+    return true;
+}
+
+shared_ptr<compressed_entry> compress_cache::compress(const string &path, time_t mtime, off_t size, ENCODING enc){
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return nullptr;
+    struct stat st;
+    // 提交后文件已变化
+    if(fstat(fd, &st) < 0 || st.st_mtime != mtime || st.st_size != size){
+        close(fd);
+        return nullptr;
+    }
+    string src(size, '\0');
+    ssize_t n = size > 0 ? pread(fd, &src[0], size, 0) : 0;
+    close(fd);
+    if(n != size)
+        return nullptr;
+
+    shared_ptr<compressed_entry> entry = make_shared<compressed_entry>();
+    entry->enc = enc;
+    bool ok = enc == ENC_GZIP ? gzip_compress(src, entry->data) : brotli_compress(src, entry->data);
+    // 压缩后节省不到一成，记为不值得压缩
+    if(!ok || entry->data.size() * 10 > src.size() * 9)
+        entry->data.clear();
+    entry->data.shrink_to_fit();
+    return entry;
+}
+
+void compress_cache::insert(const shared_ptr<compressed_entry> &entry){
+    m_lock.lock();
+    m_pending.erase(entry->key);
+    if(!m_map.count(entry->key)){
+        m_lru.push_front(entry);
+        m_map[entry->key] = m_lru.begin();
+        m_cur_bytes += entry->data.size();
+        evict();
+    }
+    m_lock.unlock();
+}
+
+void compress_cache::evict(){
+    while(!m_lru.empty() && m_cur_bytes > m_budget){
+        shared_ptr<compressed_entry> &victim = m_lru.back();
+        m_cur_bytes -= victim->data.size();
+        m_map.erase(victim->key);
+        m_lru.pop_back();
+    }
+}
+
+void* compress_cache::worker(void *arg){
+    compress_cache *cache = (compress_cache *)arg;
+    set_thread_name("compress");
+    cache->run();
+    return nullptr;
+}
+
+void compress_cache::run(){
+    while(true){
+        m_lock.lock();
+        while(m_jobs.empty())
+            m_cond.wait(m_lock.get());
+        job j = m_jobs.front();
+        m_jobs.pop_front();
+        m_lock.unlock();
+
+        shared_ptr<compressed_entry> entry = compress(j.path, j.mtime, j.size, j.enc);
+        if(!entry){
+            m_lock.lock();
+            m_pending.erase(j.key);
+            m_lock.unlock();
+            continue;
+        }
+        entry->key = j.key;
+        insert(entry);
+        LOG_INFO("compressed %s %s: %lld -> %lld", j.path.c_str(), encoding_names[j.enc],
+                 (long long)j.size, (long long)entry->data.size());
+    }
+}
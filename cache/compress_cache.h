@@ -0,0 +1,105 @@
+#ifndef COMPRESS_CACHE_H
+#define COMPRESS_CACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <list>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../locker/locker.h"
+
+using namespace std;
+
+// 内容编码，按服务端优先级排列
+enum ENCODING{
+    ENC_BR = 0, ENC_ZSTD, ENC_GZIP, ENC_NUM
+};
+// Content-Encoding取值
+extern const char *encoding_names[ENC_NUM];
+// 预先压缩文件的扩展名
+extern const char *encoding_exts[ENC_NUM];
+
+// 解析Accept-Encoding，返回可接受编码的位掩码，q=0的编码不可接受
+int parse_accept_encoding(const char *value, int len);
+// 文本类内容才值得压缩
+bool compressible(const char *mime);
+
+// 一个文件某种编码的压缩结果，data为空表示压缩后不比原文件小，不再尝试
+struct compressed_entry{
+    string key;
+    ENCODING enc;
+    string data;
+};
+
+// 压缩结果缓存，键为(路径, 修改时间, 大小, 编码)，文件变化后旧结果不再命中，由LRU淘汰
+// 未命中时提交给后台压缩线程，本次请求发送原文件，压缩不在事件循环和工作线程中进行
+class compress_cache{
+public:
+    static compress_cache* get_instance(){
+        static compress_cache instance;
+        return &instance;
+    }
+
+    // budget压缩结果总字节数上限，[min_size, max_size]为参与压缩的文件大小范围
+    bool init(size_t budget, size_t min_size, size_t max_size, int close_log);
+    // 是否启用在线压缩
+    bool active() const{
+        return m_enabled;
+    }
+    // 该大小的文件是否在线压缩
+    bool enabled(off_t size) const{
+        return m_enabled && (size_t)size >= m_min_size && (size_t)size <= m_max_size;
+    }
+    // 该编码能否在线压缩
+    static bool can_compress(ENCODING enc);
+    // 查找压缩结果，未命中返回空
+    shared_ptr<const compressed_entry> get(const char *path, const struct stat &st, ENCODING enc);
+    // 提交后台压缩，同一个键只排队一次，队列满时丢弃
+    void submit(const char *path, const struct stat &st, ENCODING enc);
+
+private:
+    compress_cache();
+    ~compress_cache();
+    compress_cache(const compress_cache&) = delete;
+    compress_cache& operator=(const compress_cache&) = delete;
+
+    static string make_key(const char *path, const struct stat &st, ENCODING enc);
+    // 读取文件并压缩，文件已变化时返回空
+    shared_ptr<compressed_entry> compress(const string &path, time_t mtime, off_t size, ENCODING enc);
+    void insert(const shared_ptr<compressed_entry> &entry);
+    // 超出预算时从LRU尾部淘汰，需持有锁
+    void evict();
+
+    static void* worker(void *arg);
+    void run();
+
+private:
+    struct job{
+        string key;
+        string path;
+        time_t mtime;
+        off_t size;
+        ENCODING enc;
+    };
+    static const size_t MAX_PENDING = 64;
+
+    typedef list<shared_ptr<compressed_entry>> lru_list;
+    lru_list m_lru;
+    unordered_map<string, lru_list::iterator> m_map;
+    deque<job> m_jobs;                  // 待压缩
+    unordered_set<string> m_pending;    // 已排队的键
+    mutexlocker m_lock;
+    condvar m_cond;
+
+    size_t m_budget;
+    size_t m_cur_bytes;
+    size_t m_min_size;
+    size_t m_max_size;
+    bool m_enabled;
+    int m_close_log;
+};
+
+#endif
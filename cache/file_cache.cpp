@@ -0,0 +1,248 @@
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+#include "file_cache.h"
+#include "../log/log.h"
+#include "../http/mime_type.h"
+#include "../threadpool/thread_affinity.h"
+
+file_entry::~file_entry(){
+    if(addr)
+        munmap(addr, st.st_size);
+    if(fd >= 0)
+        close(fd);
+}
+
+int make_etag(char *buf, int len, const struct stat &st){
+    return snprintf(buf, len, "\"%lx-%llx\"", (unsigned long)st.st_mtime, (unsigned long long)st.st_size);
+}
+
+int make_http_date(char *buf, int len, time_t t){
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, len, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+file_cache::file_cache(){
+    m_max_bytes = 0;
+    m_cur_bytes = 0;
+    m_max_entries = 0;
+    m_map_files = false;
+    m_inotify_fd = -1;
+    m_enabled = false;
+    m_gen = 0;
+    m_close_log = 0;
+}
+
+file_cache::~file_cache(){
+}
+
+bool file_cache::init(size_t max_bytes, int max_entries, bool map_files, int close_log){
+    m_max_bytes = max_bytes;
+    m_max_entries = max_entries;
+    m_map_files = map_files;
+    m_close_log = close_log;
+
+    // 没有inotify就无法感知文件变化，不启用缓存
+    m_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if(m_inotify_fd < 0){
+        LOG_ERROR("%s", "inotify_init failure, file cache disabled");
+        return false;
+    }
+    pthread_t tid;
+    if(pthread_create(&tid, nullptr, notify_thread, this) != 0){
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return false;
+    }
+    pthread_detach(tid);
+    m_enabled = true;
+    return true;
+}
+
+// 打开文件并生成条目，只缓存可读的普通文件
+shared_ptr<file_entry> file_cache::load(const char *path){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return nullptr;
+    shared_ptr<file_entry> entry = make_shared<file_entry>();
+    entry->fd = fd;
+    entry->path = path;
+    if(fstat(fd, &entry->st) < 0 || !S_ISREG(entry->st.st_mode) || !(entry->st.st_mode & S_IROTH))
+        return nullptr;
+
+    if(m_map_files && entry->st.st_size > 0){
+        void *addr = mmap(0, entry->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED)
+            return nullptr;
+        entry->addr = (char *)addr;
+    }
+
+    char etag[64], date[64], buf[384];
+    make_etag(etag, sizeof(etag), entry->st);
+    make_http_date(date, sizeof(date), entry->st.st_mtime);
+    snprintf(buf, sizeof(buf), "Content-Length:%lld\r\nContent-Type:%s\r\nETag:%s\r\nLast-Modified:%s\r\nAccept-Ranges:bytes\r\n",
+             (long long)entry->st.st_size, mime_type(path), etag, date);
+    entry->headers = buf;
+    return entry;
+}
+
+shared_ptr<const file_entry> file_cache::get(const char *path){
+    if(!m_enabled)
+        return nullptr;
+    // 键必须与inotify报告的"目录/文件名"一致，含//或/.的路径不缓存
+    if(path[0] != '/' || strstr(path, "//") || strstr(path, "/."))
+        return nullptr;
+
+    string key(path);
+    m_lock.lock();
+    unordered_map<string, lru_list::iterator>::iterator it = m_map.find(key);
+    if(it != m_map.end()){
+        // 命中，移到表头
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        shared_ptr<const file_entry> entry = *it->second;
+        m_lock.unlock();
+        return entry;
+    }
+    // 先监视目录再读文件，加载期间发生的变化不会漏掉
+    bool watched = watch_dir(key);
+    unsigned long gen = m_gen;
+    m_lock.unlock();
+
+    shared_ptr<file_entry> entry = load(path);
+    if(!entry)
+        return entry;
+    // 未进入缓存的条目不受inotify跟踪，标记为stale，避免被响应缓存等引用
+    if(!watched){
+        entry->stale = true;
+        return entry;
+    }
+
+    m_lock.lock();
+    // 加载期间有文件失效，无法确定读到的是否为旧内容，只用于本次请求
+    if(gen != m_gen || (size_t)entry->st.st_size > m_max_bytes){
+        m_lock.unlock();
+        entry->stale = true;
+        return entry;
+    }
+    it = m_map.find(key);
+    if(it != m_map.end()){
+        shared_ptr<const file_entry> exist = *it->second;
+        m_lock.unlock();
+        return exist;
+    }
+    m_lru.push_front(entry);
+    m_map[key] = m_lru.begin();
+    m_cur_bytes += entry->st.st_size;
+    evict();
+    m_lock.unlock();
+    return entry;
+}
+
+bool file_cache::watch_dir(const string &path){
+    string dir = path.substr(0, path.rfind('/'));
+    if(dir.empty())
+        dir = "/";
+    if(m_dir_wd.count(dir))
+        return true;
+    int wd = inotify_add_watch(m_inotify_fd, dir.c_str(),
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if(wd < 0){
+        LOG_WARN("inotify watch %s failure:%d", dir.c_str(), errno);
+        return false;
+    }
+    m_dir_wd[dir] = wd;
+    m_wd_dir[wd] = dir;
+    return true;
+}
+
+void file_cache::evict(){
+    while(!m_lru.empty() && (m_cur_bytes > m_max_bytes || (int)m_map.size() > m_max_entries)){
+        shared_ptr<file_entry> &victim = m_lru.back();
+        m_cur_bytes -= victim->st.st_size;
+        m_map.erase(victim->path);
+        m_lru.pop_back();
+    }
+}
+
+void file_cache::invalidate(const string &path){
+    m_lock.lock();
+    ++m_gen;
+    unordered_map<string, lru_list::iterator>::iterator it = m_map.find(path);
+    if(it != m_map.end()){
+        (*it->second)->stale = true;
+        m_cur_bytes -= (*it->second)->st.st_size;
+        m_lru.erase(it->second);
+        m_map.erase(it);
+    }
+    m_lock.unlock();
+}
+
+// 使目录下全部条目失效，dir为空表示全部
+void file_cache::invalidate_dir(const string &dir){
+    string prefix = dir + "/";
+    m_lock.lock();
+    ++m_gen;
+    for(lru_list::iterator it = m_lru.begin(); it != m_lru.end();){
+        if(dir.empty() || (*it)->path.compare(0, prefix.size(), prefix) == 0){
+            (*it)->stale = true;
+            m_cur_bytes -= (*it)->st.st_size;
+            m_map.erase((*it)->path);
+            it = m_lru.erase(it);
+        }
+        else
+            ++it;
+    }
+    m_lock.unlock();
+}
+
+void* file_cache::notify_thread(void *arg){
+    file_cache *cache = (file_cache *)arg;
+    set_thread_name("fcache-notify");
+    cache->run_notify();
+    return nullptr;
+}
+
+void file_cache::run_notify(){
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while(true){
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if(len <= 0){
+            if(len < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        for(char *p = buf; p < buf + len;){
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            // 事件丢失，无法确定哪些文件变化
+            if(event->mask & IN_Q_OVERFLOW){
+                invalidate_dir("");
+                continue;
+            }
+            m_lock.lock();
+            unordered_map<int, string>::iterator it = m_wd_dir.find(event->wd);
+            string dir = it != m_wd_dir.end() ? it->second : string();
+            // 监视已被内核移除（目录被删除或移走），之后需要重新监视
+            if(it != m_wd_dir.end() && (event->mask & IN_IGNORED)){
+                m_dir_wd.erase(dir);
+                m_wd_dir.erase(it);
+            }
+            m_lock.unlock();
+            if(dir.empty())
+                continue;
+
+            if(event->len > 0)
+                invalidate(dir + "/" + event->name);
+            else if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                invalidate_dir(dir);
+        }
+    }
+}
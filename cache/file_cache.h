@@ -0,0 +1,89 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <pthread.h>
+#include <string>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+#include "../locker/locker.h"
+
+using namespace std;
+
+// 缓存的静态文件：打开的fd、stat信息、预先生成的报头，可选的只读映射
+// 条目不可修改，由shared_ptr计数，淘汰或失效后仍在发送的响应继续持有直到发完
+struct file_entry{
+    file_entry():fd(-1), addr(nullptr), stale(false){}
+    ~file_entry();
+
+    string path;        // 文件路径，缓存的键
+    int fd;             // 只读打开的文件，供sendfile使用
+    struct stat st;     // 文件信息
+    char *addr;         // 文件映射，未映射为nullptr
+    string headers;     // Content-Length、Content-Type、ETag、Last-Modified等报头行
+    mutable atomic<bool> stale;     // 文件已变化，依赖该条目的缓存应丢弃
+};
+
+// 由修改时间和大小生成带引号的ETag，返回长度
+int make_etag(char *buf, int len, const struct stat &st);
+// IMF-fixdate格式的HTTP日期，返回长度
+int make_http_date(char *buf, int len, time_t t);
+
+// 静态文件打开与stat缓存，按路径查找，多线程共享
+// 按字节数和条目数限制大小，LRU淘汰；inotify监视文件所在目录，文件变化时使条目失效
+// 命中时只有一次加锁查找，不产生文件系统系统调用
+class file_cache{
+public:
+    static file_cache* get_instance(){
+        static file_cache instance;
+        return &instance;
+    }
+
+    // max_bytes缓存文件总大小上限，max_entries条目数上限（即占用的fd数），map_files是否映射文件内容
+    bool init(size_t max_bytes, int max_entries, bool map_files, int close_log);
+    // 查找或加载文件，不可缓存（不存在、不可读、目录等）时返回空，调用方走原来的路径处理错误
+    shared_ptr<const file_entry> get(const char *path);
+    // 使某个路径的条目失效
+    void invalidate(const string &path);
+    // 使目录下全部条目失效，空串表示全部
+    void invalidate_dir(const string &dir);
+
+private:
+    file_cache();
+    ~file_cache();
+    file_cache(const file_cache&) = delete;
+    file_cache& operator=(const file_cache&) = delete;
+
+    shared_ptr<file_entry> load(const char *path);
+    // 监视文件所在目录，需持有锁
+    bool watch_dir(const string &path);
+    // 超出限制时从LRU尾部淘汰，需持有锁
+    void evict();
+
+    // inotify线程，静态函数避免this指针
+    static void* notify_thread(void *arg);
+    void run_notify();
+
+private:
+    typedef list<shared_ptr<file_entry>> lru_list;
+
+    lru_list m_lru;                                     // 表头最近使用
+    unordered_map<string, lru_list::iterator> m_map;    // 路径到LRU位置
+    unordered_map<string, int> m_dir_wd;                // 已监视的目录
+    unordered_map<int, string> m_wd_dir;                // 监视描述符到目录
+    mutexlocker m_lock;
+
+    size_t m_max_bytes;     // 文件总大小上限
+    size_t m_cur_bytes;     // 当前文件总大小
+    int m_max_entries;      // 条目数上限
+    bool m_map_files;       // 是否映射文件内容
+    int m_inotify_fd;       // inotify句柄
+    unsigned long m_gen;    // 失效次数，用于发现加载期间发生的变化
+    bool m_enabled;
+    int m_close_log;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "response_cache.h"
+
+response_cache::response_cache(){
+    m_hand = 0;
+    m_budget = 0;
+    m_cur_bytes = 0;
+    m_max_file_size = 0;
+}
+
+response_cache::~response_cache(){
+}
+
+void response_cache::init(size_t budget, size_t max_file_size){
+    m_budget = budget;
+    m_max_file_size = max_file_size;
+}
+
+shared_ptr<const response_entry> response_cache::get(const char *path, bool linger, int accept){
+    if(m_budget == 0)
+        return nullptr;
+
+    string key = make_key(path, linger, accept);
+    m_lock.lock();
+    unordered_map<string, size_t>::iterator it = m_map.find(key);
+    if(it == m_map.end()){
+        m_lock.unlock();
+        return nullptr;
+    }
+    slot &s = m_slots[it->second];
+    // 文件已变化
+    if(s.entry->file->stale.load(std::memory_order_relaxed)){
+        remove(it->second);
+        m_lock.unlock();
+        return nullptr;
+    }
+    s.ref = true;
+    s.entry->hits.fetch_add(1, std::memory_order_relaxed);
+    shared_ptr<const response_entry> entry = s.entry;
+    m_lock.unlock();
+    return entry;
+}
+
+void response_cache::put(const char *path, bool linger, int accept, const shared_ptr<const file_entry> &file,
+                         const char *head, int head_len, const char *body, size_t body_len){
+    size_t size = head_len + body_len;
+    if(m_budget == 0 || size > m_budget)
+        return;
+
+    // 在锁外拼装响应
+    shared_ptr<response_entry> entry = make_shared<response_entry>();
+    entry->key = make_key(path, linger, accept);
+    entry->file = file;
+    entry->data.reserve(size);
+    entry->data.append(head, head_len);
+    entry->data.append(body, body_len);
+
+    m_lock.lock();
+    // 其他线程已加入，或文件在生成期间已变化
+    if(m_map.count(entry->key) || file->stale.load(std::memory_order_relaxed)){
+        m_lock.unlock();
+        return;
+    }
+    size_t idx;
+    if(!m_free.empty()){
+        idx = m_free.back();
+        m_free.pop_back();
+    }
+    else{
+        idx = m_slots.size();
+        m_slots.push_back(slot());
+    }
+    m_slots[idx].entry = entry;
+    // 新条目访问位为0，只访问一次的文件在下一轮就被淘汰
+    m_slots[idx].ref = false;
+    m_map[entry->key] = idx;
+    m_cur_bytes += size;
+    evict();
+    m_lock.unlock();
+}
+
+void response_cache::remove(size_t idx){
+    slot &s = m_slots[idx];
+    m_cur_bytes -= s.entry->data.size();
+    m_map.erase(s.entry->key);
+    s.entry.reset();
+    s.ref = false;
+    m_free.push_back(idx);
+}
+
+void response_cache::evict(){
+    while(m_cur_bytes > m_budget && !m_map.empty()){
+        if(m_hand >= m_slots.size())
+            m_hand = 0;
+        slot &s = m_slots[m_hand];
+        if(s.entry){
+            // 最近被访问过，给第二次机会
+            if(s.ref)
+                s.ref = false;
+            else
+                remove(m_hand);
+        }
+        ++m_hand;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+#include "../locker/locker.h"
+#include "file_cache.h"
+
+using namespace std;
+
+// 预先生成的完整响应：状态行、报头和正文，生成后不再修改，多个连接共享发送
+struct response_entry{
+    response_entry():hits(0){}
+
+    string key;                         // 路径加长连接标志和可接受的编码
+    shared_ptr<const file_entry> file;  // 来源文件，文件失效时响应一并失效
+    string data;                        // 完整响应报文
+    mutable atomic<unsigned long> hits; // 命中次数
+};
+
+// 小文件完整响应缓存，依赖文件缓存感知文件变化
+// 按内存预算限制大小，CLOCK淘汰：命中只置访问位，不调整顺序
+class response_cache{
+public:
+    static response_cache* get_instance(){
+        static response_cache instance;
+        return &instance;
+    }
+
+    // budget缓存响应总字节数上限，max_file_size可缓存的文件大小上限
+    void init(size_t budget, size_t max_file_size);
+    // 文件大小是否在可缓存范围内
+    bool cacheable(size_t file_size) const{
+        return m_budget > 0 && file_size <= m_max_file_size;
+    }
+    // 查找响应，未命中或来源文件已失效时返回空，accept为可接受的内容编码掩码
+    shared_ptr<const response_entry> get(const char *path, bool linger, int accept);
+    // 加入一个完整响应，head为状态行和报头
+    void put(const char *path, bool linger, int accept, const shared_ptr<const file_entry> &file,
+             const char *head, int head_len, const char *body, size_t body_len);
+
+private:
+    response_cache();
+    ~response_cache();
+    response_cache(const response_cache&) = delete;
+    response_cache& operator=(const response_cache&) = delete;
+
+    static string make_key(const char *path, bool linger, int accept){
+        string key(path);
+        key.push_back(linger ? '1' : '0');
+        key.push_back('0' + accept);
+        return key;
+    }
+    // 移除槽位上的响应，需持有锁
+    void remove(size_t idx);
+    // 超出预算时转动时钟指针淘汰，需持有锁
+    void evict();
+
+private:
+    struct slot{
+        shared_ptr<response_entry> entry;
+        bool ref;       // 访问位
+    };
+
+    vector<slot> m_slots;                       // 时钟环
+    vector<size_t> m_free;                      // 空闲槽位
+    unordered_map<string, size_t> m_map;        // 键到槽位
+    size_t m_hand;                              // 时钟指针
+    mutexlocker m_lock;
+
+    size_t m_budget;        // 内存预算
+    size_t m_cur_bytes;     // 当前占用
+    size_t m_max_file_size; // 可缓存的文件大小上限
+};
+
+#endif
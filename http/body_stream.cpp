@@ -0,0 +1,195 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+#include "body_stream.h"
+
+spill_sink::~spill_sink(){
+    if(m_fd >= 0)
+        close(m_fd);
+}
+
+bool spill_sink::open(const char *dir){
+    m_fd = ::open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    return m_fd >= 0;
+}
+
+bool spill_sink::write(const char *data, int len){
+    while(len > 0){
+        ssize_t n = ::write(m_fd, data, len);
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+        m_size += n;
+    }
+    return true;
+}
+
+void chunked_decoder::reset(){
+    m_state = SIZE;
+    m_remain = 0;
+    m_total = 0;
+    m_digits = 0;
+}
+
+static int hex_value(char c){
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+int chunked_decoder::feed(const char *data, int len, body_sink *sink, long long limit){
+    int i = 0;
+    while(i < len && m_state != DONE){
+        char c = data[i];
+        switch(m_state){
+            // 块长度，十六进制
+            case SIZE:{
+                int v = hex_value(c);
+                if(v >= 0){
+                    // 超过15位会溢出
+                    if(++m_digits > 15)
+                        return -1;
+                    m_remain = m_remain * 16 + v;
+                }
+                else if(m_digits == 0)
+                    return -1;
+                else if(c == ';')
+                    m_state = EXT;
+                else if(c == '\r')
+                    m_state = SIZE_LF;
+                else
+                    return -1;
+                ++i;
+                break;
+            }
+            // 块扩展，忽略
+            case EXT:{
+                if(c == '\r')
+                    m_state = SIZE_LF;
+                ++i;
+                break;
+            }
+            case SIZE_LF:{
+                if(c != '\n')
+                    return -1;
+                // 在块数据到达之前按声明的长度检查上限
+                if(m_remain > limit - m_total)
+                    return -2;
+                // 长度为0的块表示结束，后面是尾部报头
+                m_state = m_remain == 0 ? TRAILER : DATA;
+                ++i;
+                break;
+            }
+            // 块数据，整段交给sink
+            case DATA:{
+                int n = len - i < m_remain ? len - i : (int)m_remain;
+                if(!sink->write(data + i, n))
+                    return -1;
+                m_remain -= n;
+                m_total += n;
+                i += n;
+                if(m_remain == 0)
+                    m_state = DATA_CR;
+                break;
+            }
+            case DATA_CR:{
+                if(c != '\r')
+                    return -1;
+                m_state = DATA_LF;
+                ++i;
+                break;
+            }
+            case DATA_LF:{
+                if(c != '\n')
+                    return -1;
+                m_state = SIZE;
+                m_digits = 0;
+                ++i;
+                break;
+            }
+            // 尾部报头行首，空行表示结束
+            case TRAILER:{
+                m_state = c == '\r' ? TRAILER_LF : TRAILER_LINE;
+                ++i;
+                break;
+            }
+            // 尾部报头，忽略
+            case TRAILER_LINE:{
+                if(c == '\r')
+                    m_state = TRAILER_LINE_LF;
+                ++i;
+                break;
+            }
+            case TRAILER_LINE_LF:{
+                if(c != '\n')
+                    return -1;
+                m_state = TRAILER;
+                ++i;
+                break;
+            }
+            case TRAILER_LF:{
+                if(c != '\n')
+                    return -1;
+                m_state = DONE;
+                ++i;
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+    return i;
+}
+
+body_router::body_router(){
+    m_default_max = 64LL << 20;
+    m_spill_dir = "/tmp";
+}
+
+void body_router::init(long long default_max, const char *spill_dir){
+    m_default_max = default_max;
+    m_spill_dir = spill_dir;
+}
+
+void body_router::add(const string &prefix, long long max_body, body_factory factory){
+    body_route route;
+    route.prefix = prefix;
+    route.max_body = max_body;
+    route.factory = factory;
+    m_routes.push_back(route);
+}
+
+const body_route* body_router::match(const char *url, long long &limit) const{
+    const body_route *best = nullptr;
+    for(size_t i = 0; i < m_routes.size(); ++i){
+        const body_route &route = m_routes[i];
+        if(strncmp(url, route.prefix.c_str(), route.prefix.size()) == 0 &&
+           (!best || route.prefix.size() > best->prefix.size()))
+            best = &route;
+    }
+    limit = best ? best->max_body : m_default_max;
+    return best;
+}
+
+body_sink* body_router::create(const char *url) const{
+    long long limit;
+    const body_route *route = match(url, limit);
+    if(route)
+        return route->factory(url);
+    spill_sink *sink = new spill_sink;
+    if(!sink->open(m_spill_dir.c_str())){
+        delete sink;
+        return nullptr;
+    }
+    return sink;
+}
@@ -0,0 +1,110 @@
+#ifndef BODY_STREAM_H
+#define BODY_STREAM_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+// 消息体消费者，按到达顺序接收消息体，超过阈值的消息体不在读缓冲中积累
+class body_sink{
+public:
+    virtual ~body_sink(){}
+    // 写入一段数据，返回false表示中止接收
+    virtual bool write(const char *data, int len) = 0;
+    // 消息体接收完毕
+    virtual bool finish(){
+        return true;
+    }
+};
+
+// 溢出文件：写入目录下的匿名临时文件，fd关闭后文件自动删除
+class spill_sink : public body_sink{
+public:
+    spill_sink():m_fd(-1), m_size(0){}
+    ~spill_sink();
+
+    bool open(const char *dir);
+    bool write(const char *data, int len);
+    int fd() const{
+        return m_fd;
+    }
+    long long size() const{
+        return m_size;
+    }
+
+private:
+    int m_fd;
+    long long m_size;
+};
+
+// 分块传输编码解码器，可在任意字节处中断，下次从中断处继续
+class chunked_decoder{
+public:
+    chunked_decoder(){
+        reset();
+    }
+    void reset();
+    // 解析[data, data + len)，块数据直接交给sink，返回消耗的字节数
+    // 格式错误或sink中止返回-1，解码完成后不再消耗后续字节
+    // 块长度使已解码总量超过limit时返回-2，超出部分不交给sink
+    int feed(const char *data, int len, body_sink *sink, long long limit);
+    bool done() const{
+        return m_state == DONE;
+    }
+    // 已解码的消息体字节数
+    long long total() const{
+        return m_total;
+    }
+
+private:
+    enum STATE{
+        SIZE = 0, EXT, SIZE_LF, DATA, DATA_CR, DATA_LF,
+        TRAILER, TRAILER_LINE, TRAILER_LINE_LF, TRAILER_LF, DONE
+    };
+    STATE m_state;
+    long long m_remain;     // 当前块剩余字节数
+    long long m_total;
+    int m_digits;           // 块长度的十六进制位数
+};
+
+typedef function<body_sink*(const char *url)> body_factory;
+
+// 按url前缀配置的消息体处理方式
+struct body_route{
+    string prefix;
+    long long max_body;     // 消息体上限
+    body_factory factory;   // 创建消费者，返回nullptr表示拒绝
+};
+
+// 大消息体的路由表，未配置的url写入溢出文件
+class body_router{
+public:
+    static body_router* get_instance(){
+        static body_router instance;
+        return &instance;
+    }
+
+    // 默认的消息体上限和溢出文件目录
+    void init(long long default_max, const char *spill_dir);
+    // 注册前缀路由，需在服务启动前完成，运行期间只读
+    void add(const string &prefix, long long max_body, body_factory factory);
+    // 按最长前缀匹配，limit返回该url的消息体上限
+    const body_route* match(const char *url, long long &limit) const;
+    // 创建url对应的消费者，失败返回nullptr
+    body_sink* create(const char *url) const;
+
+private:
+    body_router();
+    ~body_router(){}
+    body_router(const body_router&) = delete;
+    body_router& operator=(const body_router&) = delete;
+
+private:
+    vector<body_route> m_routes;
+    long long m_default_max;
+    string m_spill_dir;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include <cstring>
+
+#include "header_rules.h"
+
+void header_rules::add(const string &prefix, const string &content_type, const string &cache_control){
+    header_rule rule;
+    rule.prefix = prefix;
+    rule.content_type = content_type;
+    rule.cache_control = cache_control;
+    m_rules.push_back(rule);
+}
+
+const header_rule* header_rules::match(const char *path) const{
+    const header_rule *best = nullptr;
+    for(size_t i = 0; i < m_rules.size(); ++i){
+        const header_rule &rule = m_rules[i];
+        if(strncmp(path, rule.prefix.c_str(), rule.prefix.size()) == 0 &&
+           (!best || rule.prefix.size() > best->prefix.size()))
+            best = &rule;
+    }
+    return best;
+}
@@ -0,0 +1,39 @@
+#ifndef HEADER_RULES_H
+#define HEADER_RULES_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 按路径前缀配置的响应报头，空串表示不设置
+struct header_rule{
+    string prefix;
+    string content_type;    // 覆盖按扩展名确定的Content-Type
+    string cache_control;   // Cache-Control取值
+};
+
+// 静态文件响应报头的规则表，路径为相对资源根目录的文件路径
+class header_rules{
+public:
+    static header_rules* get_instance(){
+        static header_rules instance;
+        return &instance;
+    }
+
+    // 注册前缀规则，需在服务启动前完成，运行期间只读
+    void add(const string &prefix, const string &content_type, const string &cache_control);
+    // 按最长前缀匹配，未匹配返回nullptr
+    const header_rule* match(const char *path) const;
+
+private:
+    header_rules(){}
+    ~header_rules(){}
+    header_rules(const header_rules&) = delete;
+    header_rules& operator=(const header_rules&) = delete;
+
+private:
+    vector<header_rule> m_rules;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include <time.h>
+
+#include "header_writer.h"
+
+namespace header_writer{
+
+const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+fragment status_line(int status){
+    switch(status){
+        case 200: return HEADER_FRAGMENT("HTTP/1.1 200 OK\r\n");
+        case 206: return HEADER_FRAGMENT("HTTP/1.1 206 Partial Content\r\n");
+        case 304: return HEADER_FRAGMENT("HTTP/1.1 304 Not Modified\r\n");
+        case 400: return HEADER_FRAGMENT("HTTP/1.1 400 Bad Request\r\n");
+        case 403: return HEADER_FRAGMENT("HTTP/1.1 403 Forbidden\r\n");
+        case 404: return HEADER_FRAGMENT("HTTP/1.1 404 Not Found\r\n");
+        case 405: return HEADER_FRAGMENT("HTTP/1.1 405 Method Not Allowed\r\n");
+        case 413: return HEADER_FRAGMENT("HTTP/1.1 413 Payload Too Large\r\n");
+        case 416: return HEADER_FRAGMENT("HTTP/1.1 416 Range Not Satisfiable\r\n");
+        case 500: return HEADER_FRAGMENT("HTTP/1.1 500 Internal Error\r\n");
+        default: return fragment{nullptr, 0};
+    }
+}
+
+fragment connection(bool keep_alive){
+    return keep_alive ? HEADER_FRAGMENT("Connection:keep-alive\r\n") : HEADER_FRAGMENT("Connection:close\r\n");
+}
+
+const char* date_line(){
+    // 每个线程各自缓存，不需要加锁
+    static thread_local time_t cached = 0;
+    static thread_local char line[DATE_LINE_LEN + 1];
+    time_t now = time(nullptr);
+    if(now != cached){
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        memcpy(line, "Date:", 5);
+        strftime(line + 5, sizeof(line) - 5, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        memcpy(line + DATE_LINE_LEN - 2, "\r\n", 2);
+        cached = now;
+    }
+    return line;
+}
+
+}
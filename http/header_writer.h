@@ -0,0 +1,65 @@
+#ifndef HEADER_WRITER_H
+#define HEADER_WRITER_H
+
+#include <cstring>
+
+// 响应报头的拼接工具：常量片段预先计算好长度，整数和日期不经过printf
+namespace header_writer{
+
+// 一段长度已知的常量报文
+struct fragment{
+    const char *data;
+    int len;
+};
+#define HEADER_FRAGMENT(s) header_writer::fragment{s, sizeof(s) - 1}
+
+// Date报头行"Date:Sun, 06 Nov 1994 08:49:37 GMT\r\n"定长
+const int DATE_LINE_LEN = 36;
+// 十进制无符号整数的最大位数
+const int UINT_DIGITS = 20;
+
+// 状态码对应的状态行，不认识的状态码返回len为0
+fragment status_line(int status);
+// Connection报头行
+fragment connection(bool keep_alive);
+// 当前时间的Date报头行，每个线程每秒格式化一次
+const char* date_line();
+
+extern const char digit_pairs[201];
+
+// 无符号整数转十进制，每次除以100查表写两位，buf至少UINT_DIGITS字节，返回长度
+inline int format_uint(char *buf, unsigned long long v){
+    char tmp[UINT_DIGITS];
+    char *p = tmp + UINT_DIGITS;
+    while(v >= 100){
+        const char *d = digit_pairs + (v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        p[0] = d[0];
+        p[1] = d[1];
+    }
+    if(v >= 10){
+        const char *d = digit_pairs + v * 2;
+        p -= 2;
+        p[0] = d[0];
+        p[1] = d[1];
+    }
+    else
+        *--p = '0' + v;
+    int len = tmp + UINT_DIGITS - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+// 依次写入片段，返回写入后的位置，调用方保证空间足够
+inline char* put(char *p, const char *data, int len){
+    memcpy(p, data, len);
+    return p + len;
+}
+inline char* put(char *p, fragment f){
+    return put(p, f.data, f.len);
+}
+
+}
+
+#endif
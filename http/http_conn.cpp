@@ -1,7 +1,11 @@
 #include <mysql/mysql.h>
 #include <fstream>
+#include <climits>
+#include <new>
 
 #include "http_conn.h"
+#include "mime_type.h"
+#include "simd_scan.h"
 
 const char *ok_200_title = "OK";
 const char *error_400_title = "Bad Request";
@@ -10,12 +14,81 @@ const char *error_403_title = "Forbidden";
 const char *error_403_form = "You do not have permission to get file form this server.\n";
 const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
+const char *error_405_title = "Method Not Allowed";
+const char *error_405_form = "The request method is not supported by this server.\n";
+const char *partial_206_title = "Partial Content";
+const char *not_modified_304_title = "Not Modified";
+const char *error_416_title = "Range Not Satisfiable";
+const char *error_416_form = "The requested range is not satisfiable.\n";
+const char *error_413_title = "Payload Too Large";
+const char *error_413_form = "The request body exceeds the limit of this server.\n";
+// OPTIONS与405响应的Allow取值
+const char *allowed_methods = "GET, HEAD, POST, OPTIONS";
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
 mutexlocker m_lock;         // 表互斥锁
 map<string, string> users;  // 内存用户表
 
+// 从user=xxx&password=yyy中取出用户名和密码
+static bool parse_user(const route_request &req, string &name, string &password){
+    const char *body = req.body;
+    const char *end = body + req.body_len;
+    if(!body || req.body_len < 5 || strncmp(body, "user=", 5) != 0)
+        return false;
+    const char *amp = (const char *)memchr(body, '&', req.body_len);
+    if(!amp || end - amp < 10 || strncmp(amp, "&password=", 10) != 0)
+        return false;
+    name.assign(body + 5, amp - body - 5);
+    password.assign(amp + 10, end - amp - 10);
+    return true;
+}
+
+// 登录：用户名和密码在表中可以查找到则进入欢迎页
+static bool login(const route_request &req, route_response &res){
+    string name, password;
+    bool ok = false;
+    if(parse_user(req, name, password)){
+        m_lock.lock();
+        map<string, string>::iterator it = users.find(name);
+        ok = it != users.end() && it->second == password;
+        m_lock.unlock();
+    }
+    res.file = ok ? "/welcome.html" : "/logError.html";
+    return true;
+}
+
+// 注册：没有重名的则写入数据库，进入登录页
+static bool register_user(const route_request &req, route_response &res){
+    string name, password;
+    res.file = "/registerError.html";
+    if(!parse_user(req, name, password) || name.size() > 100 || password.size() > 100)
+        return true;
+    char sql_insert[300];
+    snprintf(sql_insert, sizeof(sql_insert), "INSERT INTO user(username, password) VALUES('%s', '%s')",
+             name.c_str(), password.c_str());
+    m_lock.lock();
+    if(users.find(name) == users.end()){
+        int ret = mysql_query(req.mysql, sql_insert);
+        users.insert(pair<string, string>(name, password));
+        if(!ret)
+            res.file = "/log.html";
+    }
+    m_lock.unlock();
+    return true;
+}
+
+void http_conn::init_routes(){
+    router *r = router::get_instance();
+    r->add_alias("/0", "/register.html");
+    r->add_alias("/1", "/log.html");
+    r->add_exact("/2CGISQL.cgi", ROUTE_POST, login);
+    r->add_exact("/3CGISQL.cgi", ROUTE_POST, register_user);
+    r->add_alias("/5", "/picture.html");
+    r->add_alias("/6", "/video.html");
+    r->add_alias("/7", "/fans.html");
+}
+
 void http_conn::initmysql_result(connection_pool *connPool){
     // 从数据库连接池取一个连接
     MYSQL *mysql = nullptr;
@@ -70,6 +143,16 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode){
     setnonblocking(fd);
 }
 
+// 固定模式：一次性注册ET读写事件，之后不再修改
+void addfd_persist(int epollfd, int fd){
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+    setnonblocking(fd);
+}
+
 // 从内核事件表删除描述符，关闭描述符
 void removefd(int epollfd, int fd){
     epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
@@ -89,36 +172,54 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode){
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;
+std::atomic<int> http_conn::m_user_count(0);
+int http_conn::m_precompressed = 0;
 int http_conn::m_epollfd = -1;
+int http_conn::m_zero_copy = 0;
+int http_conn::m_max_requests = 0;
 
 // 关闭一个客户连接
 void http_conn::close_conn(bool real_close){
     if(real_close && (m_sockfd != -1)){
         printf("close %d\n", m_sockfd);
-        removefd(m_epollfd, m_sockfd);
+        if(m_loop_epollfd >= 0)
+            removefd(m_loop_epollfd, m_sockfd);
+        else
+            close(m_sockfd);
         m_sockfd = -1;
         m_user_count--;
+        unmap();
+        reset_body();
+        release_buffers();
     }
 }
 
 // 初始化连接
 void http_conn::init(int sockfd, const sockaddr_in &addr, const char *root, int TRIGMode, 
-                     int close_log, string user, string passwd, string sqlname){
+                     int close_log, int epollfd, bool pinned){
+    // 上一个使用该槽位的连接可能在发送中途被关闭
+    unmap();
     m_sockfd = sockfd;
+    m_worker.store(-1, std::memory_order_relaxed);
+    m_busy.store(0, std::memory_order_relaxed);
+    m_request_count = 0;
+    m_phase.store(PHASE_HEADER, std::memory_order_relaxed);
     m_address = addr;
-
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    m_loop_epollfd = epollfd == -1 ? m_epollfd : epollfd;
+    m_pinned = pinned && m_loop_epollfd >= 0;
+    m_offload = false;
+    // 持久注册只能是边沿触发，读写都必须做到EAGAIN
+    m_TRIGMode = m_pinned ? 1 : TRIGMode;
+
+    if(m_pinned)
+        addfd_persist(m_loop_epollfd, sockfd);
+    else if(m_loop_epollfd >= 0)
+        addfd(m_loop_epollfd, sockfd, true, m_TRIGMode);
     m_user_count++;
 
     doc_root = root;
-    m_TRIGMode = TRIGMode;
     m_close_log = close_log;
 
-    strcpy(sql_user, user.c_str());
-    strcpy(sql_passwd, passwd.c_str());
-    strcpy(sql_name, sqlname.c_str());
-
     init();
 }
 
@@ -137,56 +238,162 @@ void http_conn::init(){
     m_checked_idx = 0;
     m_read_idx = 0;
     m_write_idx = 0;
-    cgi = 0;
+    m_iv_count = 0;
+    m_body_count = 0;
+    m_keep_alive = false;
+    m_read_full = false;
+    m_content_length = 0;
+    m_header_count = 0;
+    m_range_count = 0;
+    m_accept = 0;
+    m_encoding = nullptr;
+    m_rule = nullptr;
+    reset_body();
+    m_string = 0;
     m_state = 0;
     timer_flag = 0;
     improv = 0;
 
-    memset(m_read_buf, 0, READ_BUFFER_SIZE);
-    memset(m_write_buf, 0, WRITE_BUFFER_SIZE);
-    memset(m_real_file, 0, FILENAME_LEN);
+    // 缓冲区和请求状态在收到数据时再取用
+    release_buffers();
 }
 
 // 从状态机，用于分析一行内容
+// 向量化查找下一个\r或\n，不再逐字节比较
 http_conn::LINE_STATUS http_conn::parse_line(){
-    char temp;
     //m_read_idx指向缓冲区m_read_buf的数据末尾的下一个字节
     //m_checked_idx指向从状态机当前正在分析的字节
-    for(; m_checked_idx < m_read_idx; ++m_checked_idx){
-        temp = m_read_buf[m_checked_idx];
-        // 可能读取到完整行
-        if(temp == '\r'){
-            // 不完整
-            if((m_checked_idx + 1) == m_read_idx){
-                return LINE_OPEN;
-            }
-            // 完整，\r\n替换为\0\0
-            else if(m_read_buf[m_checked_idx + 1] == '\n'){
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            // 格式错误
-            return LINE_BAD;
-        }
-        // 可能读取到完整行
-        else if(temp == '\n'){
-            // 完整，\r\n替换为\0\0
-            if(m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r'){
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    if(m_checked_idx >= m_read_idx)
+        return LINE_OPEN;
+    const char *end = m_read_buf + m_read_idx;
+    const char *p = simd_scan::find_eol(m_read_buf + m_checked_idx, end);
+    m_checked_idx = p - m_read_buf;
+    // 继续接收
+    if(p == end)
+        return LINE_OPEN;
+    // 可能读取到完整行
+    if(*p == '\r'){
+        // 不完整
+        if(p + 1 == end)
+            return LINE_OPEN;
+        // 完整，\r\n替换为\0\0
+        if(p[1] == '\n'){
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        // 格式错误
+        return LINE_BAD;
     }
-    // 继续接收
-    return LINE_OPEN;
+    // 单独的\n
+    return LINE_BAD;
+}
+
+bool http_conn::reserve_read(int need){
+    // 多留一个字节，消息体末尾填\0时不越界
+    need += 1;
+    if(m_read_buf && m_read_size - m_read_idx >= need)
+        return true;
+    // 新请求到达，请求状态与读缓冲一起取用
+    if(!m_req && !acquire_state())
+        return false;
+    int cap;
+    int size = m_read_buf ? m_read_size * 2 : READ_BUFFER_SIZE;
+    while(size < m_read_idx + need)
+        size *= 2;
+    char *buf = buffer_pool::get_instance()->alloc(size, cap);
+    // 超过缓冲池最大级别
+    if(!buf){
+        if(!m_read_buf)
+            release_state();
+        return false;
+    }
+    if(m_read_buf){
+        memcpy(buf, m_read_buf, m_read_idx);
+        // 已解析出的字段指向旧缓冲，按相同偏移移到新缓冲
+        ptrdiff_t delta = buf - m_read_buf;
+        if(m_url)
+            m_url += delta;
+        if(m_version)
+            m_version += delta;
+        if(m_host)
+            m_host += delta;
+        if(m_string)
+            m_string += delta;
+        buffer_pool::get_instance()->free(m_read_buf, m_read_size);
+    }
+    m_read_buf = buf;
+    m_read_size = cap;
+    return true;
+}
+
+bool http_conn::reserve_write(int need){
+    if(m_write_buf && m_write_size - m_write_idx >= need)
+        return true;
+    int cap;
+    int size = m_write_buf ? m_write_size * 2 : WRITE_BUFFER_SIZE;
+    while(size < m_write_idx + need)
+        size *= 2;
+    char *buf = buffer_pool::get_instance()->alloc(size, cap);
+    if(!buf)
+        return false;
+    if(m_write_buf){
+        memcpy(buf, m_write_buf, m_write_idx);
+        // 流水线上已生成的响应报头在向量中指向旧缓冲
+        for(int i = 0; i < m_iv_count; ++i){
+            char *base = (char *)m_req->iv[i].iov_base;
+            if(base >= m_write_buf && base <= m_write_buf + m_write_size)
+                m_req->iv[i].iov_base = buf + (base - m_write_buf);
+        }
+        buffer_pool::get_instance()->free(m_write_buf, m_write_size);
+    }
+    m_write_buf = buf;
+    m_write_size = cap;
+    return true;
+}
+
+void http_conn::release_buffers(){
+    buffer_pool *pool = buffer_pool::get_instance();
+    if(m_read_buf){
+        pool->free(m_read_buf, m_read_size);
+        m_read_buf = nullptr;
+        m_read_size = 0;
+    }
+    if(m_write_buf){
+        pool->free(m_write_buf, m_write_size);
+        m_write_buf = nullptr;
+        m_write_size = 0;
+    }
+    release_state();
+}
+
+bool http_conn::acquire_state(){
+    int cap;
+    char *block = buffer_pool::get_instance()->alloc(sizeof(request_state), cap);
+    if(!block)
+        return false;
+    // 值初始化，路径与ETag为空串
+    m_req = new(block) request_state();
+    m_req->cap = cap;
+    return true;
+}
+
+void http_conn::release_state(){
+    if(!m_req)
+        return;
+    int cap = m_req->cap;
+    m_req->~request_state();
+    buffer_pool::get_instance()->free((char *)m_req, cap);
+    m_req = nullptr;
 }
 
 // 循环读取客户数据，直到无数据可读或对方关闭连接
+// 缓冲区满时从缓冲池换更大的块，达到上限仍放不下则关闭连接
 bool http_conn::read_once(){
-    if(m_read_idx >= READ_BUFFER_SIZE){
+    // 消息体出错时不再读取，由process生成错误响应
+    if(!drain_body(1))
+        return true;
+    if(!reserve_read(1)){
         return false;
     }
     int bytes_read = 0;
@@ -194,18 +401,30 @@ bool http_conn::read_once(){
     // LT模式
     if(m_TRIGMode == 0){
         // 读取数据到缓冲区
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - 1 - m_read_idx, 0);
 
         if(bytes_read <= 0){
             return false;
         }
+        m_read_idx += bytes_read;
+        on_data();
         return true;
     }
     // ET模式
     else{
+        int total = 0;
+        m_read_full = false;
         while(true){
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            if(!drain_body(1))
+                break;
+            // 报头未解析时消息体还没有消费者，缓冲已到上限就先交给解析，处理后再读
+            if(!reserve_read(1)){
+                if(total == 0)
+                    return false;
+                m_read_full = true;
+                break;
+            }
+            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - 1 - m_read_idx, 0);
             // 无数据可读
             if(bytes_read == -1){
                 // 非阻塞、连接正常
@@ -218,39 +437,63 @@ bool http_conn::read_once(){
                 return false;
             }
             m_read_idx += bytes_read;
+            total += bytes_read;
         }
+        if(total > 0)
+            on_data();
+        return true;
+    }
+}
+
+// 追加外部I/O引擎收到的数据
+bool http_conn::read_from(const char *data, int len){
+    if(!drain_body(len))
         return true;
+    if(!reserve_read(len)){
+        return false;
     }
+    memcpy(m_read_buf + m_read_idx, data, len);
+    m_read_idx += len;
+    on_data();
+    return true;
+}
+
+// 空闲的长连接收到新请求，开始计算请求头超时
+void http_conn::on_data(){
+    if(m_phase.load(std::memory_order_relaxed) == PHASE_IDLE)
+        m_phase.store(PHASE_HEADER, std::memory_order_relaxed);
 }
 
 // 解析HTTP请求行，获得请求方法、目标url及http版本号
-http_conn::HTTP_CODE http_conn::parse_request_line(char *text){
+http_conn::HTTP_CODE http_conn::parse_request_line(char *text, int len){
+    char *end = text + len;
     // 寻找空格和\t位置
-    m_url = strpbrk(text, " \t");
-    if(!m_url){
+    m_url = (char *)simd_scan::find_space(text, end);
+    if(m_url == end){
         return BAD_REQUEST;
     }
     // 将该位置改为\0，方便取出
     *m_url++ = '\0';
-    // 取出请求方法并比较
-    char *method = text;
-    if(strcasecmp(method, "GET") == 0)
-        m_method = GET;
-    else if(strcasecmp(method, "POST") == 0){
-        m_method = POST;
-        cgi = 1;
-    }
-    else return BAD_REQUEST;
+    // 查表取出请求方法
+    int method = http_token::find_method(text, m_url - 1 - text);
+    if(method < 0)
+        return BAD_REQUEST;
+    // 可以识别但不支持的方法，消息体未读，响应后关闭连接
+    if(method != GET && method != POST && method != HEAD && method != OPTIONS)
+        return METHOD_NOT_ALLOWED;
+    m_method = (METHOD)method;
 
     // 跳过空格和\t
-    m_url += strspn(m_url, " \t");
+    while(m_url < end && (*m_url == ' ' || *m_url == '\t'))
+        ++m_url;
     // 再寻找空格和\t
-    m_version = strpbrk(m_url, " \t");
-    if(!m_version)
+    m_version = (char *)simd_scan::find_space(m_url, end);
+    if(m_version == end)
         return BAD_REQUEST;
     *m_version++ = '\0';
     // 跳过空格和\t
-    m_version += strspn(m_version, " \t");
+    while(m_version < end && (*m_version == ' ' || *m_version == '\t'))
+        ++m_version;
 
     // 仅支持HTTP1.1
     if(strcasecmp(m_version, "HTTP/1.1") != 0)
@@ -266,6 +509,11 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text){
         m_url = strchr(m_url, '/');
     }
 
+    // OPTIONS *询问服务器整体支持的方法
+    if(m_method == OPTIONS && strcmp(m_url, "*") == 0){
+        m_check_state = CHECK_STATE_HEADER;
+        return NO_REQUEST;
+    }
     if(!m_url || m_url[0] != '/')
         return BAD_REQUEST;
     // url为/，显示主页
@@ -277,240 +525,734 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text){
     return NO_REQUEST;
 }
 
+// 严格解析Content-Length：只允许十进制数字，前后可有空白，不溢出
+static bool parse_content_length(const char *text, const char *end, long long &value){
+    while(end > text && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    if(text == end)
+        return false;
+    long long v = 0;
+    for(const char *p = text; p < end; ++p){
+        if(*p < '0' || *p > '9')
+            return false;
+        if(v > (LLONG_MAX - (*p - '0')) / 10)
+            return false;
+        v = v * 10 + (*p - '0');
+    }
+    value = v;
+    return true;
+}
+
 // 解析HTTP请求的一个头部信息
-http_conn::HTTP_CODE http_conn::parse_headers(char *text){
-    // 首位为\0是空行
-    if(text[0] == '\0'){
-        if(m_content_length != 0){
-            // POST继续解析消息体
-            m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
+// 按冒号切分出名称和值记入报头表，值在行尾已有\0结尾
+http_conn::HTTP_CODE http_conn::parse_headers(char *text, int len){
+    // 空行
+    if(len == 0){
+        // 同时带Content-Length和分块编码时消息体边界有歧义，拒绝
+        if(m_chunked && m_has_length){
+            m_linger = false;
+            return BAD_REQUEST;
         }
         // GET请求解析完成
-        return GET_REQUEST;
+        if(m_content_length == 0 && !m_chunked)
+            return GET_REQUEST;
+        // POST继续解析消息体
+        m_check_state = CHECK_STATE_CONTENT;
+        m_phase.store(PHASE_BODY, std::memory_order_relaxed);
+        // 分块编码或超过阈值的消息体边到达边交给消费者
+        if(m_chunked || m_content_length > BODY_INLINE_MAX){
+            HTTP_CODE ret = start_body();
+            if(ret != NO_REQUEST)
+                return ret;
+        }
+        // 客户端在等待确认，前面没有待发送的流水线响应时先回复100
+        if(m_expect_continue && m_read_idx == m_checked_idx && m_iv_count == 0){
+            static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            send(m_sockfd, cont, sizeof(cont) - 1, MSG_NOSIGNAL);
+        }
+        return NO_REQUEST;
+    }
+    char *end = text + len;
+    char *colon = (char *)simd_scan::find_char(text, end, ':');
+    // 没有冒号的行直接跳过
+    if(colon == end)
+        return NO_REQUEST;
+    char *value = colon + 1;
+    while(value < end && (*value == ' ' || *value == '\t'))
+        ++value;
+    http_token::HEADER id = http_token::find_header(text, colon - text);
+
+    if(m_header_count < MAX_HEADERS){
+        header_span &span = m_req->headers[m_header_count++];
+        span.name_off = text - m_read_buf;
+        span.name_len = colon - text;
+        span.value_off = value - m_read_buf;
+        span.value_len = end - value;
+        span.id = id;
     }
-    // 连接字段
-    else if(strncasecmp(text, "connection:", 11) == 0){
-        text += 11;
-        text += strspn(text, " \t");
-        if(strcasecmp(text, "keep-alive") == 0){
-            // 长连接
-            m_linger = true;
+
+    switch(id){
+        // 连接字段
+        case http_token::H_CONNECTION:{
+            if(strcasecmp(value, "keep-alive") == 0){
+                // 长连接
+                m_linger = true;
+            }
+            break;
+        }
+        // 内容长度字段
+        // 消息体边界由它决定，格式错误或重复出现时无法确定下一个请求从哪里开始，响应400后关闭连接
+        case http_token::H_CONTENT_LENGTH:{
+            if(m_has_length || !parse_content_length(value, end, m_content_length)){
+                m_linger = false;
+                return BAD_REQUEST;
+            }
+            m_has_length = true;
+            break;
+        }
+        // 分块传输编码，由消费者接收
+        case http_token::H_TRANSFER_ENCODING:{
+            if(strcasestr(value, "chunked"))
+                m_chunked = true;
+            break;
+        }
+        case http_token::H_EXPECT:{
+            if(strcasecmp(value, "100-continue") == 0)
+                m_expect_continue = true;
+            break;
+        }
+        // Host字段，请求站点
+        case http_token::H_HOST:{
+            m_host = value;
+            break;
         }
+        // 其余报头只记入报头表，未识别的报头跳过
+        default:
+            break;
     }
-    // 内容长度字段
-    else if(strncasecmp(text, "Content-length:", 15) == 0){
-        text += 15;
-        text += strspn(text, "\t");
-        m_content_length = atol(text);
+    return NO_REQUEST;
+}
+
+const char* http_conn::get_header(const char *name, int &len) const{
+    int name_len = strlen(name);
+    for(int i = 0; i < m_header_count; ++i){
+        const header_span &span = m_req->headers[i];
+        if(span.name_len == name_len && strncasecmp(m_read_buf + span.name_off, name, name_len) == 0){
+            len = span.value_len;
+            return m_read_buf + span.value_off;
+        }
     }
-    // Host字段，请求站点
-    else if(strncasecmp(text, "Host:", 5) == 0){
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+    return nullptr;
+}
+
+const char* http_conn::get_header(http_token::HEADER id, int &len) const{
+    for(int i = 0; i < m_header_count; ++i){
+        if(m_req->headers[i].id == id){
+            len = m_req->headers[i].value_len;
+            return m_read_buf + m_req->headers[i].value_off;
+        }
+    }
+    return nullptr;
+}
+
+// 判断HTTP请求是否被完全读入
+// 只比较已到达字节数与消息体长度，不重复扫描消息体
+http_conn::HTTP_CODE http_conn::parse_content(){
+    if(m_body_sink)
+        return stream_content();
+    if(m_read_idx - m_checked_idx < m_content_length)
+        return NO_REQUEST;
+    char *text = m_read_buf + m_checked_idx;
+    // 最后填充\0，被覆盖的字节可能属于下一个流水线请求，先保存
+    m_body_end = text[m_content_length];
+    text[m_content_length] = '\0';
+    // 获取消息体
+    m_string = text;
+    m_checked_idx += m_content_length;
+    m_start_line = m_checked_idx;
+    return GET_REQUEST;
+}
+
+http_conn::HTTP_CODE http_conn::start_body(){
+    body_router *router = body_router::get_instance();
+    router->match(m_url, m_body_limit);
+    if(m_content_length > m_body_limit)
+        return body_error(PAYLOAD_TOO_LARGE);
+    m_body_sink = router->create(m_url);
+    if(!m_body_sink)
+        return body_error(INTERNAL_ERROR);
+    m_chunk.reset();
+    m_body_received = 0;
+    m_body_status = NO_REQUEST;
+    return NO_REQUEST;
+}
+
+// 消费后的字节移出读缓冲，读缓冲只保留报头和一次读入的数据，内存不随消息体增长
+http_conn::HTTP_CODE http_conn::stream_content(){
+    if(m_body_status != NO_REQUEST)
+        return m_body_status;
+    char *data = m_read_buf + m_checked_idx;
+    int avail = m_read_idx - m_checked_idx;
+    // 消费者最多收到上限为止的数据，超出上限的数据一到达就拒绝
+    long long room = m_body_limit - m_body_received;
+    int used;
+    bool done;
+    if(m_chunked){
+        // 输入中含分块格式，上限由解码器按块长度检查
+        used = m_chunk.feed(data, avail, m_body_sink, m_body_limit);
+        if(used == -2)
+            return body_error(PAYLOAD_TOO_LARGE);
+        if(used < 0)
+            return body_error(BAD_REQUEST);
+        m_body_received = m_chunk.total();
+        done = m_chunk.done();
     }
     else{
-        LOG_INFO("oop! unknow header: %s", text);
+        long long remain = m_content_length - m_body_received;
+        if(remain > room)
+            remain = room;
+        used = avail < remain ? avail : (int)remain;
+        if(used < avail && m_body_received + used < m_content_length)
+            return body_error(PAYLOAD_TOO_LARGE);
+        if(used > 0 && !m_body_sink->write(data, used))
+            return body_error(INTERNAL_ERROR);
+        m_body_received += used;
+        done = m_body_received == m_content_length;
     }
-    return NO_REQUEST;
+    // 消息体之后可能是下一个流水线请求
+    if(used > 0){
+        memmove(data, data + used, avail - used);
+        m_read_idx -= used;
+    }
+    if(!done)
+        return NO_REQUEST;
+    if(!m_body_sink->finish())
+        return body_error(INTERNAL_ERROR);
+    m_start_line = m_checked_idx;
+    m_body_status = GET_REQUEST;
+    return GET_REQUEST;
 }
 
-// 判断HTTP请求是否被完全读入
-http_conn::HTTP_CODE http_conn::parse_content(char *text){
-    // 判断buffer中是否读取了消息体
-    if(m_read_idx >= (m_content_length + m_checked_idx)){
-        // 最后填充\0
-        text[m_content_length] = '\0';
-        // 获取消息体
-        m_string = text;
-        return GET_REQUEST;
+bool http_conn::drain_body(int need){
+    if(!m_body_sink || m_check_state != CHECK_STATE_CONTENT || m_read_size - m_read_idx > need)
+        return true;
+    HTTP_CODE ret = stream_content();
+    return ret == NO_REQUEST || ret == GET_REQUEST;
+}
+
+http_conn::HTTP_CODE http_conn::body_error(HTTP_CODE code){
+    // 剩余的消息体无法跳过，响应后关闭连接
+    m_linger = false;
+    m_body_status = code;
+    return code;
+}
+
+void http_conn::reset_body(){
+    delete m_body_sink;
+    m_body_sink = nullptr;
+    m_has_length = false;
+    m_chunked = false;
+    m_expect_continue = false;
+    m_body_received = 0;
+    m_body_status = NO_REQUEST;
+}
+
+// 请求在一次读取中完整到达是最常见的情况，按行切分后直接交给请求行和报头解析，
+// 不经过从状态机的返回码与主状态机的循环；遇到不完整或不规范的行即返回，
+// 此时m_checked_idx停在已解析行之后，由通用路径接着处理
+http_conn::HTTP_CODE http_conn::parse_fast(){
+    char *end = m_read_buf + m_read_idx;
+    char *line = m_read_buf + m_start_line;
+    while(m_check_state != CHECK_STATE_CONTENT){
+        char *eol = (char *)simd_scan::find_eol(line, end);
+        if(end - eol < 2 || eol[0] != '\r' || eol[1] != '\n'){
+            // 已扫描过的字节不再扫描
+            m_checked_idx = eol - m_read_buf;
+            return NO_REQUEST;
+        }
+        eol[0] = '\0';
+        eol[1] = '\0';
+        m_checked_idx = m_start_line = eol + 2 - m_read_buf;
+        HTTP_CODE ret;
+        if(m_check_state == CHECK_STATE_REQUESTLINE)
+            ret = parse_request_line(line, eol - line);
+        else
+            ret = parse_headers(line, eol - line);
+        if(ret != NO_REQUEST)
+            return ret;
+        line = eol + 2;
     }
     return NO_REQUEST;
 }
 
 http_conn::HTTP_CODE http_conn::process_read()
 {
-    // 初始化状态
-    LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
-    char *text = nullptr;
+    // 循环线程已解析完的请求，在线程池中从这里继续
+    if(m_offload){
+        m_offload = false;
+        return do_request();
+    }
+    // 新请求从头开始解析，先走快速路径
+    if(m_check_state == CHECK_STATE_REQUESTLINE && m_checked_idx == m_start_line){
+        ret = parse_fast();
+        if(ret == GET_REQUEST)
+            return dispatch_request();
+        else if(ret != NO_REQUEST)
+            return ret;
+    }
 
-    // 消息体末尾没有字符，POST请求报文不能用从状态机LINE_OK状态判断
-    // 加上&& line_status == LINE_OK防止陷入死循环
-    while((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) || ((line_status = parse_line()) == LINE_OK)){
+    // 通用路径：从上次停下的位置继续，只扫描新到达的字节
+    LINE_STATUS line_status = LINE_OK;
+    while(m_check_state != CHECK_STATE_CONTENT && (line_status = parse_line()) == LINE_OK){
         // 取一行数据
-        text = get_line();
+        char *text = get_line();
+        // 行长度，不含已置为\0\0的\r\n
+        int len = m_checked_idx - m_start_line - 2;
         m_start_line = m_checked_idx;
         LOG_INFO("get line: %s", text);
 
         // 主状态机状态
-        switch (m_check_state){
-            case CHECK_STATE_REQUESTLINE:{
-                ret = parse_request_line(text);
-                if(ret == BAD_REQUEST)
-                    return BAD_REQUEST;
-                break;
-            }
-            case CHECK_STATE_HEADER:{
-                ret = parse_headers(text);
-                if(ret == BAD_REQUEST)
-                    return BAD_REQUEST;
-                // 完整解析GET请求
-                else if(ret == GET_REQUEST)
-                    return do_request();
-                break;
-            }
-            case CHECK_STATE_CONTENT:{
-                ret = parse_content(text);
-                // 完整解析POST请求
-                if(ret == GET_REQUEST)
-                    return do_request();
-                // 完成报文解析，防止进入循环
-                line_status = LINE_OPEN;
-                break;
-            }
-            default:
-                return INTERNAL_ERROR;
-        }
+        if(m_check_state == CHECK_STATE_REQUESTLINE)
+            ret = parse_request_line(text, len);
+        else
+            ret = parse_headers(text, len);
+        // 完整解析GET请求
+        if(ret == GET_REQUEST)
+            return dispatch_request();
+        else if(ret != NO_REQUEST)
+            return ret;
+    }
+    if(line_status == LINE_BAD)
+        return BAD_REQUEST;
+
+    if(m_check_state == CHECK_STATE_CONTENT){
+        ret = parse_content();
+        // 完整解析POST请求
+        if(ret == GET_REQUEST)
+            return dispatch_request();
+        return ret;
     }
     return NO_REQUEST;
 }
 
+http_conn::HTTP_CODE http_conn::dispatch_request(){
+    if(m_pinned){
+        const route *r = router::get_instance()->match(m_url);
+        if(r && r->handler && (r->methods & (1 << m_method))){
+            m_offload = true;
+            return WORKER_REQUEST;
+        }
+    }
+    return do_request();
+}
+
 http_conn::HTTP_CODE http_conn::do_request(){
+    // 达到单连接请求数上限，本响应后关闭；在查响应缓存之前决定，缓存按是否长连接区分
+    if(m_max_requests > 0 && ++m_request_count >= m_max_requests)
+        m_linger = false;
+
+    // 所有资源支持的方法相同，不必查找文件
+    if(m_method == OPTIONS)
+        return OPTIONS_REQUEST;
+
     // 网站根目录
-    strcpy(m_real_file, doc_root);
+    strcpy(m_req->real_file, doc_root);
     int len = strlen(doc_root);
 
-    // 找到最后一个/的位置
-    const char *p = strrchr(m_url, '/');
-
-    // POST请求，实现登录和注册校验
-    if(cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3')){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        // 将用户名和密码提取出来
-        // user=123&password=123
-        char name[100], password[100];
-        int i;
-        for(i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for(i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-        if(*(p + 1) == '3'){
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, password) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if(users.find(name) == users.end()){
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if(!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            }
-            else
-                strcpy(m_url, "/registerError.html");
-        }
-        //如果是登录，直接判断
-        //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if(*(p + 1) == '2')
-        {
-            if(users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+    // 按路由表分发，未注册的url直接对应资源根目录下的文件
+    const char *file = m_url;
+    const route *r = router::get_instance()->match(m_url);
+    if(r){
+        if(!(r->methods & (1 << m_method)))
+            return METHOD_NOT_ALLOWED;
+        if(r->handler){
+            // 只有处理函数才借用数据库连接，静态文件请求不占用连接池
+            connectionRAII mysqlcon(&mysql, connection_pool::get_instance());
+            // 流式接收的消息体不在读缓冲中，把消费者交给处理函数
+            spill_sink *spill = dynamic_cast<spill_sink *>(m_body_sink);
+            route_request req = {m_method, m_url, m_string, m_string ? m_content_length : m_body_received, mysql,
+                                 m_body_sink, spill ? spill->fd() : -1};
+            m_req->route.reset();
+            if(!r->handler(req, m_req->route))
+                return INTERNAL_ERROR;
+            // 处理函数直接生成了响应
+            if(!m_req->route.file)
+                return ROUTE_RESPONSE;
+            file = m_req->route.file;
         }
+        else
+            file = r->file.c_str();
+    }
+    strncpy(m_req->real_file + len, file, FILENAME_LEN - len - 1);
+
+    m_rule = header_rules::get_instance()->match(m_req->real_file + len);
+
+    // 条件请求和范围请求的响应因请求而异，不走响应缓存；HEAD忽略Range
+    int hlen;
+    bool readonly = m_method == GET || m_method == HEAD;
+    bool ranged = m_method == GET && get_header(http_token::H_RANGE, hlen);
+    bool conditional = ranged || (readonly && (get_header(http_token::H_IF_NONE_MATCH, hlen) ||
+                                               get_header(http_token::H_IF_MODIFIED_SINCE, hlen)));
+    // 可接受的内容编码，范围请求只针对原文件
+    if(readonly && !ranged && (m_precompressed || compress_cache::get_instance()->active())){
+        const char *value = get_header(http_token::H_ACCEPT_ENCODING, hlen);
+        if(value)
+            m_accept = parse_accept_encoding(value, hlen);
     }
-    // GET请求，跳转到注册页面
-    if(*(p + 1) == '0'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
 
-        free(m_url_real);
+    // 小文件的完整响应已缓存，直接发送；缓存的响应带有正文，HEAD不使用
+    if(!conditional && m_method != HEAD){
+        m_req->response = response_cache::get_instance()->get(m_req->real_file, m_linger, m_accept);
+        if(m_req->response)
+            return FILE_REQUEST;
     }
-    // GET请求，跳转到登录页面
-    else if(*(p + 1) == '1'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
 
-        free(m_url_real);
+    // 命中文件缓存时不再stat
+    m_req->file = file_cache::get_instance()->get(m_req->real_file);
+    if(m_req->file)
+        m_req->file_stat = m_req->file->st;
+    else{
+        // 获取不到文件信息，资源不存在
+        if(stat(m_req->real_file, &m_req->file_stat) < 0)
+            return NO_RESOURCE;
+
+        // 文件是否可读
+        if(!(m_req->file_stat.st_mode & S_IROTH))
+            return FORBIDDEN_REQUEST;
+
+        // 文件是否为目录
+        if(S_ISDIR(m_req->file_stat.st_mode))
+            return BAD_REQUEST;
     }
-    // POST请求，图片页面
-    else if(*(p + 1) == '5'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
 
-        free(m_url_real);
+    m_variant_final = true;
+    if(m_accept)
+        select_encoding();
+    if(!m_req->etag[0])
+        make_etag(m_req->etag, sizeof(m_req->etag), m_req->file_stat);
+
+    // 未修改或范围无效时不必打开文件
+    HTTP_CODE ret = check_conditional();
+    if(ret != FILE_REQUEST && ret != PARTIAL_CONTENT){
+        m_req->file.reset();
+        m_req->compressed.reset();
+        return ret;
+    }
+    // 压缩结果在内存中；HEAD只需要文件信息，不打开文件
+    if(m_req->compressed || m_method == HEAD)
+        return ret;
+
+    if(m_req->file){
+        // 多段范围需要映射的文件内容
+        if(m_zero_copy && m_loop_epollfd != NO_EPOLL && m_range_count <= 1){
+            m_file_fd = m_req->file->fd;
+            set_file_range();
+            return ret;
+        }
+        if(m_req->file->addr || m_req->file_stat.st_size == 0){
+            m_file_address = m_req->file->addr;
+            return ret;
+        }
+        // 缓存未映射文件内容，按原方式处理
+        m_req->file.reset();
     }
-    // POST请求，视频页面
-    else if(*(p + 1) == '6'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
 
-        free(m_url_real);
+    // 以只读方式打开文件并映射到内存中
+    int fd = open(m_req->variant_file[0] ? m_req->variant_file : m_req->real_file, O_RDONLY);
+    // 零拷贝模式保留fd交给sendfile，不建立映射；io_uring引擎仍按向量发送
+    if(m_zero_copy && m_loop_epollfd != NO_EPOLL && fd >= 0 && m_range_count <= 1){
+        m_file_fd = fd;
+        set_file_range();
+        return ret;
     }
-    // POST请求，关注页面
-    else if(*(p + 1) == '7'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    m_file_address = (char *)mmap(0, m_req->file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 关闭文件描述符
+    close(fd);
+    return ret;
+}
 
-        free(m_url_real);
+// 按Accept-Encoding选择压缩版本，只处理文本类文件
+// 优先发送同目录下预先压缩的文件，其次是后台压缩的结果；都没有时提交压缩，本次发送原文件
+void http_conn::select_encoding(){
+    if(!S_ISREG(m_req->file_stat.st_mode) || !compressible(content_type()))
+        return;
+    int len = strlen(m_req->real_file);
+    for(int e = 0; m_precompressed && e < ENC_NUM; ++e){
+        if(!(m_accept & (1 << e)) || len + strlen(encoding_exts[e]) >= FILENAME_LEN)
+            continue;
+        char path[FILENAME_LEN];
+        snprintf(path, sizeof(path), "%s%s", m_req->real_file, encoding_exts[e]);
+        struct stat st;
+        shared_ptr<const file_entry> file = file_cache::get_instance()->get(path);
+        if(file)
+            st = file->st;
+        else if(stat(path, &st) < 0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH))
+            continue;
+        m_req->file = file;
+        m_req->file_stat = st;
+        strcpy(m_req->variant_file, path);
+        m_encoding = encoding_names[e];
+        return;
     }
-    else
-        // 都不是则直接拼接
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
 
-    // 获取不到文件信息，资源不存在
-    if(stat(m_real_file, &m_file_stat) < 0)
-        return NO_RESOURCE;
+    compress_cache *cache = compress_cache::get_instance();
+    if(!cache->enabled(m_req->file_stat.st_size))
+        return;
+    int wanted = -1;
+    for(int e = 0; e < ENC_NUM; ++e){
+        if(!(m_accept & (1 << e)) || !compress_cache::can_compress((ENCODING)e))
+            continue;
+        shared_ptr<const compressed_entry> entry = cache->get(m_req->real_file, m_req->file_stat, (ENCODING)e);
+        if(entry){
+            // 压缩无收益，发送原文件
+            if(entry->data.empty())
+                return;
+            m_req->compressed = entry;
+            m_encoding = encoding_names[e];
+            // 与原文件的ETag区分
+            int n = make_etag(m_req->etag, sizeof(m_req->etag), m_req->file_stat);
+            snprintf(m_req->etag + n - 1, sizeof(m_req->etag) - n + 1, "-%s\"", m_encoding);
+            return;
+        }
+        if(wanted < 0)
+            wanted = e;
+    }
+    // HEAD不触发压缩
+    if(wanted >= 0 && m_method == GET){
+        cache->submit(m_req->real_file, m_req->file_stat, (ENCODING)wanted);
+        // 压缩完成前发送原文件，不进入响应缓存
+        m_variant_final = false;
+    }
+}
 
-    // 文件是否可读
-    if(!(m_file_stat.st_mode & S_IROTH))
-        return FORBIDDEN_REQUEST;
+// 解析HTTP日期，失败返回-1
+static time_t parse_http_date(const char *text){
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if(!strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return -1;
+    return timegm(&tm);
+}
 
-    // 文件是否为目录
-    if(S_ISDIR(m_file_stat.st_mode))
-        return BAD_REQUEST;
+// 实体标签列表中是否有与etag弱比较相等的，*匹配任意
+static bool etag_match(const char *list, int len, const char *etag){
+    int etag_len = strlen(etag);
+    const char *end = list + len;
+    while(list < end){
+        while(list < end && (*list == ' ' || *list == '\t' || *list == ','))
+            ++list;
+        const char *tok = list;
+        while(list < end && *list != ',')
+            ++list;
+        const char *tok_end = list;
+        while(tok_end > tok && (tok_end[-1] == ' ' || tok_end[-1] == '\t'))
+            --tok_end;
+        if(tok_end - tok == 1 && *tok == '*')
+            return true;
+        if(tok_end - tok > 2 && strncmp(tok, "W/", 2) == 0)
+            tok += 2;
+        if(tok_end - tok == etag_len && strncmp(tok, etag, etag_len) == 0)
+            return true;
+    }
+    return false;
+}
 
-    // 以只读方式打开文件并映射到内存中
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    // 关闭文件描述符
-    close(fd);
-    return FILE_REQUEST;
+http_conn::HTTP_CODE http_conn::check_conditional(){
+    m_range_count = 0;
+    if(m_method != GET && m_method != HEAD)
+        return FILE_REQUEST;
+
+    const char *etag = m_req->etag;
+    int len;
+    // If-None-Match优先于If-Modified-Since
+    const char *value = get_header(http_token::H_IF_NONE_MATCH, len);
+    if(value){
+        if(etag_match(value, len, etag))
+            return NOT_MODIFIED;
+    }
+    else if((value = get_header(http_token::H_IF_MODIFIED_SINCE, len))){
+        time_t since = parse_http_date(value);
+        if(since != -1 && m_req->file_stat.st_mtime <= since)
+            return NOT_MODIFIED;
+    }
+
+    value = m_method == GET ? get_header(http_token::H_RANGE, len) : nullptr;
+    if(!value)
+        return FILE_REQUEST;
+    // If-Range不匹配说明客户端的部分内容已过期，返回完整文件
+    int if_len;
+    const char *if_range = get_header(http_token::H_IF_RANGE, if_len);
+    if(if_range){
+        if(if_range[0] == '"' || strncmp(if_range, "W/", 2) == 0){
+            if(if_len != (int)strlen(etag) || strncmp(if_range, etag, if_len) != 0)
+                return FILE_REQUEST;
+        }
+        else if(parse_http_date(if_range) != m_req->file_stat.st_mtime)
+            return FILE_REQUEST;
+    }
+    return parse_range(value, len);
+}
+
+// 解析bytes=a-b,c-,-n形式的范围，不认识的单位或段数过多时忽略Range
+http_conn::HTTP_CODE http_conn::parse_range(const char *text, int len){
+    const char *end = text + len;
+    if(len < 6 || strncasecmp(text, "bytes=", 6) != 0)
+        return FILE_REQUEST;
+    off_t size = m_req->file_stat.st_size;
+    const char *p = text + 6;
+    int specs = 0;
+    while(p < end){
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            ++p;
+        if(p == end)
+            break;
+        if(++specs > MAX_RANGES){
+            m_range_count = 0;
+            return FILE_REQUEST;
+        }
+        char *next;
+        off_t start, last;
+        if(*p == '-'){
+            // 最后n个字节
+            long long n = strtoll(p + 1, &next, 10);
+            if(next == p + 1)
+                return FILE_REQUEST;
+            start = n >= size ? 0 : size - n;
+            last = size - 1;
+            if(n == 0)
+                start = size;
+        }
+        else{
+            start = strtoll(p, &next, 10);
+            if(next == p || *next != '-')
+                return FILE_REQUEST;
+            p = next + 1;
+            last = strtoll(p, &next, 10);
+            if(next == p)
+                last = size - 1;
+            else if(last < start)
+                return FILE_REQUEST;
+            if(last >= size)
+                last = size - 1;
+        }
+        p = next;
+        while(p < end && (*p == ' ' || *p == '\t'))
+            ++p;
+        if(p < end && *p != ',')
+            return FILE_REQUEST;
+        // 起点超出文件的段无法满足，跳过
+        if(start < size){
+            m_req->ranges[m_range_count].start = start;
+            m_req->ranges[m_range_count].last = last;
+            ++m_range_count;
+        }
+    }
+    if(m_range_count == 0)
+        return specs > 0 ? RANGE_NOT_SATISFIABLE : FILE_REQUEST;
+    return PARTIAL_CONTENT;
+}
+
+// sendfile发送的文件区间：单段范围或整个文件
+void http_conn::set_file_range(){
+    if(m_range_count == 1){
+        m_file_offset = m_req->ranges[0].start;
+        m_file_end = m_req->ranges[0].last + 1;
+    }
+    else{
+        m_file_offset = 0;
+        m_file_end = m_req->file_stat.st_size;
+    }
 }
 
 // 关闭文件映射
 void http_conn::unmap(){
+    // 没有请求状态时不持有任何正文
+    if(!m_req)
+        return;
+    for(int i = 0; i < m_body_count; ++i){
+        if(m_req->bodies[i].map_addr)
+            munmap(m_req->bodies[i].map_addr, m_req->bodies[i].map_len);
+        m_req->bodies[i].map_addr = 0;
+        m_req->bodies[i].file.reset();
+        m_req->bodies[i].response.reset();
+        m_req->bodies[i].compressed.reset();
+    }
+    m_body_count = 0;
+    m_req->response.reset();
+    m_req->compressed.reset();
+    // 缓存条目的fd与映射由缓存释放
+    if(m_req->file){
+        m_req->file.reset();
+        m_file_address = 0;
+        m_file_fd = -1;
+        return;
+    }
     if(m_file_address){
-        munmap(m_file_address, m_file_stat.st_size);
+        munmap(m_file_address, m_req->file_stat.st_size);
         m_file_address = 0;
     }
+    if(m_file_fd >= 0){
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+}
+
+// 报头带MSG_MORE，内核等正文到来后合并成满包发出；正文由sendfile从页缓存直接拷到socket
+// sendfile自行推进m_file_offset，EAGAIN后从断点继续
+ssize_t http_conn::send_file(){
+    // 文件正文总是最后一段，之前的流水线响应和本响应报头都在向量中
+    if(bytes_to_send > m_file_end - m_file_offset){
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = m_req->iv;
+        msg.msg_iovlen = m_iv_count;
+        return sendmsg(m_sockfd, &msg, MSG_MORE);
+    }
+    ssize_t ret = sendfile(m_sockfd, m_file_fd, &m_file_offset, bytes_to_send);
+    // 文件在发送期间被截断
+    if(ret == 0){
+        errno = EIO;
+        return -1;
+    }
+    return ret;
+}
+
+// 已发送n字节，调整向量
+bool http_conn::on_sent(int n){
+    bytes_have_send += n;
+    bytes_to_send -= n;
+    // 跳过已发送完的元素，从第一个未发完的元素的断点继续
+    for(int i = 0; i < m_iv_count && n > 0; ++i){
+        size_t len = (size_t)n < m_req->iv[i].iov_len ? (size_t)n : m_req->iv[i].iov_len;
+        m_req->iv[i].iov_base = (char *)m_req->iv[i].iov_base + len;
+        m_req->iv[i].iov_len -= len;
+        n -= len;
+    }
+    return bytes_to_send <= 0;
+}
+
+// 响应全部发送完毕
+bool http_conn::finish_response(){
+    unmap();
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    m_write_idx = 0;
+    m_iv_count = 0;
+    // 写缓冲总是归还；读缓冲中没有剩余数据时连同请求状态一起归还，空闲长连接不占缓冲
+    buffer_pool *pool = buffer_pool::get_instance();
+    pool->free(m_write_buf, m_write_size);
+    m_write_buf = nullptr;
+    m_write_size = 0;
+    if(m_read_idx == 0){
+        pool->free(m_read_buf, m_read_size);
+        m_read_buf = nullptr;
+        m_read_size = 0;
+        release_state();
+    }
+    m_phase.store(m_read_idx > 0 ? PHASE_HEADER : PHASE_IDLE, std::memory_order_relaxed);
+    // 长连接，读缓冲中已解析到一半或尚未解析的流水线数据保留
+    return m_keep_alive;
 }
 
 // 向客户端写响应
@@ -519,20 +1261,26 @@ bool http_conn::write(){
 
     // 响应报文为空
     if(bytes_to_send == 0){
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        // 固定模式下可写事件随时会到，没有待发数据时不能重置已读入的请求
+        if(m_pinned)
+            return true;
+        rearm(EPOLLIN);
         init();
         return true;
     }
 
     while(1){
         // 发送响应
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        if(m_file_fd >= 0)
+            temp = send_file();
+        else
+            temp = writev(m_sockfd, m_req->iv, m_iv_count);
 
         if(temp < 0){
             // 重试，继续监听写事件
             if(errno == EAGAIN)
             {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                rearm(EPOLLOUT);
                 // 不要断开连接
                 return true;
             }
@@ -541,101 +1289,138 @@ bool http_conn::write(){
             return false;
         }
 
-        // 正常发送
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-        // 第一个元素已经发送完
-        if(bytes_have_send >= m_iv[0].iov_len){
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        // 继续发送第一个元素
-        else{
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
-
         // 全部发送完毕
-        if(bytes_to_send <= 0){
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-
-            // 长连接
-            if(m_linger){
-                init();
-                return true;
-            }
-            else{
+        if(on_sent(temp)){
+            if(!finish_response())
                 return false;
-            }
+            // 读缓冲中还有流水线数据，由调用方再次process，此时不能注册读事件
+            if(!has_buffered())
+                rearm(EPOLLIN);
+            return true;
         }
     }
 }
 
 // 写响应
 bool http_conn::add_response(const char *format, ...){
-    // 写入内容超过buffer长度则报错
-    if(m_write_idx >= WRITE_BUFFER_SIZE)
+    if(!reserve_write(128))
         return false;
-    
+
     // 可变参数列表
     va_list arg_list;
     // 初始化列表
     va_start(arg_list, format);
+    va_list arg_copy;
+    va_copy(arg_copy, arg_list);
 
     // 按照format写入缓存
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    // 超出缓存则报错
-    if(len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)){
-        va_end(arg_list);
-        return false;
+    int len = vsnprintf(m_write_buf + m_write_idx, m_write_size - m_write_idx, format, arg_list);
+    va_end(arg_list);
+    // 超出缓存则扩大后重写
+    if(len >= m_write_size - m_write_idx){
+        if(!reserve_write(len + 1)){
+            va_end(arg_copy);
+            return false;
+        }
+        vsnprintf(m_write_buf + m_write_idx, m_write_size - m_write_idx, format, arg_copy);
     }
+    va_end(arg_copy);
 
     // 更新idx
     m_write_idx += len;
-    va_end(arg_list);
+    return true;
+}
 
-    LOG_INFO("add response: %s", m_write_buf);
+// 常用报头不经过格式化，直接拷贝
+bool http_conn::add_bytes(const char *data, int len){
+    if(!reserve_write(len))
+        return false;
+    memcpy(m_write_buf + m_write_idx, data, len);
+    m_write_idx += len;
+    return true;
+}
+
+// 一行报头：名称带冒号，值原样写入
+bool http_conn::add_field(header_writer::fragment name, const char *value, int len){
+    if(!reserve_write(name.len + len + 2))
+        return false;
+    char *p = header_writer::put(m_write_buf + m_write_idx, name);
+    p = header_writer::put(p, value, len);
+    p = header_writer::put(p, "\r\n", 2);
+    m_write_idx = p - m_write_buf;
     return true;
 }
 
-// 状态行
+// 状态行，其后紧跟Date与Vary报头
+// 同一url的响应随Accept-Encoding而不同，错误、304、处理函数的响应也都带Vary，共享缓存不会把某一版本发给其他客户端
 bool http_conn::add_status_line(int status, const char *title){
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    LOG_INFO("add response: %d %s", status, title);
+    header_writer::fragment line = header_writer::status_line(status);
+    if(!line.len && !add_response("%s %d %s\r\n", "HTTP/1.1", status, title))
+        return false;
+    header_writer::fragment vary = HEADER_FRAGMENT("Vary:Accept-Encoding\r\n");
+    if(!reserve_write(line.len + header_writer::DATE_LINE_LEN + vary.len))
+        return false;
+    char *p = header_writer::put(m_write_buf + m_write_idx, line);
+    p = header_writer::put(p, header_writer::date_line(), header_writer::DATE_LINE_LEN);
+    p = header_writer::put(p, vary);
+    m_write_idx = p - m_write_buf;
+    return true;
 }
 
 // 响应报头
-bool http_conn::add_headers(int content_len){
+bool http_conn::add_headers(long long content_len){
     return add_content_length(content_len) && add_linger() &&
            add_blank_line();
 }
 
 // 消息报头
-bool http_conn::add_content_length(int content_len){
-    return add_response("Content-Length:%d\r\n", content_len);
+bool http_conn::add_content_length(long long content_len){
+    char value[header_writer::UINT_DIGITS];
+    int len = header_writer::format_uint(value, content_len);
+    return add_field(HEADER_FRAGMENT("Content-Length:"), value, len);
 }
 
 bool http_conn::add_content_type(){
-    return add_response("Content-Type:%s\r\n", "text/html");
+    const char *type = content_type();
+    return add_field(HEADER_FRAGMENT("Content-Type:"), type, strlen(type));
+}
+
+const char* http_conn::content_type() const{
+    if(m_rule && !m_rule->content_type.empty())
+        return m_rule->content_type.c_str();
+    return mime_type(m_req->real_file);
+}
+
+// 按路径规则设置的缓存策略，未配置时不发送
+bool http_conn::add_cache_control(){
+    if(!m_rule || m_rule->cache_control.empty())
+        return true;
+    return add_field(HEADER_FRAGMENT("Cache-Control:"), m_rule->cache_control.data(), m_rule->cache_control.size());
 }
 
 bool http_conn::add_linger(){
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    header_writer::fragment line = header_writer::connection(m_linger);
+    return add_bytes(line.data, line.len);
 }
 
 // 空行
 bool http_conn::add_blank_line(){
-    return add_response("%s", "\r\n");
+    if(!add_bytes("\r\n", 2))
+        return false;
+    m_head_end = m_write_idx;
+    return true;
 }
 
 // 响应正文
 bool http_conn::add_content(const char *content){
-    return add_response("%s", content);
+    return add_bytes(content, strlen(content));
 }
 
 // 向缓冲区写响应
 bool http_conn::process_write(HTTP_CODE ret){
+    // 流水线上前面的响应已写在缓冲区中，本响应从这里开始
+    int head = m_write_idx;
     switch (ret){
         case INTERNAL_ERROR:{
             add_status_line(500, error_500_title);
@@ -644,10 +1429,17 @@ bool http_conn::process_write(HTTP_CODE ret){
                 return false;
             break;
         }
+        case PAYLOAD_TOO_LARGE:{
+            add_status_line(413, error_413_title);
+            add_headers(strlen(error_413_form));
+            if(!add_content(error_413_form))
+                return false;
+            break;
+        }
         case BAD_REQUEST:{
-            add_status_line(404, error_404_title);
-            add_headers(strlen(error_404_form));
-            if(!add_content(error_404_form))
+            add_status_line(400, error_400_title);
+            add_headers(strlen(error_400_form));
+            if(!add_content(error_400_form))
                 return false;
             break;
         }
@@ -658,18 +1450,95 @@ bool http_conn::process_write(HTTP_CODE ret){
                 return false;
             break;
         }
+        case METHOD_NOT_ALLOWED:{
+            add_status_line(405, error_405_title);
+            add_field(HEADER_FRAGMENT("Allow:"), allowed_methods, strlen(allowed_methods));
+            add_headers(strlen(error_405_form));
+            if(!add_content(error_405_form))
+                return false;
+            break;
+        }
+        // 处理函数生成的响应，正文留在请求状态的route中直接发送
+        case ROUTE_RESPONSE:{
+            add_status_line(m_req->route.status, m_req->route.title);
+            add_content_length(m_req->route.body.size());
+            add_field(HEADER_FRAGMENT("Content-Type:"), m_req->route.content_type, strlen(m_req->route.content_type));
+            add_linger();
+            if(!add_blank_line())
+                return false;
+            add_iov(m_write_buf + head, m_write_idx - head);
+            if(m_method != HEAD)
+                add_iov(m_req->route.body.data(), m_req->route.body.size());
+            return true;
+        }
+        case OPTIONS_REQUEST:{
+            add_status_line(200, ok_200_title);
+            add_field(HEADER_FRAGMENT("Allow:"), allowed_methods, strlen(allowed_methods));
+            if(!add_headers(0))
+                return false;
+            break;
+        }
+        case NOT_MODIFIED:{
+            add_status_line(304, not_modified_304_title);
+            if(!add_validators() || !add_cache_control() || !add_linger() || !add_blank_line())
+                return false;
+            break;
+        }
+        case RANGE_NOT_SATISFIABLE:{
+            add_status_line(416, error_416_title);
+            add_response("Content-Range:bytes */%lld\r\n", (long long)m_req->file_stat.st_size);
+            add_headers(strlen(error_416_form));
+            if(!add_content(error_416_form))
+                return false;
+            break;
+        }
+        case PARTIAL_CONTENT:
+            return add_partial(head);
         case FILE_REQUEST:{
+            // 命中响应缓存，不再格式化报头；缓存的报文以状态行、Date和Vary开头，换成当前的再发送其余部分
+            if(m_req->response){
+                if(!add_status_line(200, ok_200_title))
+                    return false;
+                size_t skip = m_write_idx - head;
+                add_iov(m_write_buf + head, skip);
+                add_iov(m_req->response->data.data() + skip, m_req->response->data.size() - skip);
+                return true;
+            }
             add_status_line(200, ok_200_title);
-            if(m_file_stat.st_size != 0){
-                add_headers(m_file_stat.st_size);
-                // 第一个元素指向响应报文写缓冲
-                m_iv[0].iov_base = m_write_buf;
-                m_iv[0].iov_len = m_write_idx;
-                // 第二个元素指向mmap返回的文件指针
-                m_iv[1].iov_base = m_file_address;
-                m_iv[1].iov_len = m_file_stat.st_size;
-                m_iv_count = 2;
-                bytes_to_send = m_write_idx + m_file_stat.st_size;
+            // 压缩结果在内存中
+            if(m_req->compressed){
+                if(!add_file_headers(m_req->compressed->data.size()))
+                    return false;
+                if(m_method == HEAD)
+                    break;
+                store_response(head, m_req->compressed->data.data(), m_req->compressed->data.size());
+                add_iov(m_write_buf + head, m_write_idx - head);
+                add_iov(m_req->compressed->data.data(), m_req->compressed->data.size());
+                return true;
+            }
+            if(m_req->file_stat.st_size != 0){
+                // 缓存条目带有预先生成的报头，预先压缩的文件和规则指定类型的文件需要另外生成
+                if(m_req->file && !m_encoding && !(m_rule && !m_rule->content_type.empty())){
+                    add_bytes(m_req->file->headers.data(), m_req->file->headers.size());
+                    add_cache_control();
+                    add_linger();
+                    if(!add_blank_line())
+                        return false;
+                }
+                else if(!add_file_headers(m_req->file_stat.st_size))
+                    return false;
+                if(m_method == HEAD)
+                    break;
+                store_response(head, m_req->file ? m_req->file->addr : nullptr, m_req->file_stat.st_size);
+                // 报头在写缓冲中
+                add_iov(m_write_buf + head, m_write_idx - head);
+                // 零拷贝模式正文由sendfile发送
+                if(m_file_fd >= 0){
+                    bytes_to_send += m_req->file_stat.st_size;
+                    return true;
+                }
+                // 正文指向mmap返回的文件指针
+                add_iov(m_file_address, m_req->file_stat.st_size);
                 return true;
             }
             // 资源大小为0则返回空白html
@@ -679,30 +1548,239 @@ bool http_conn::process_write(HTTP_CODE ret){
                 if(!add_content(ok_string))
                     return false;
             }
+            break;
         }
         default:
             return false;
     }
-    // 除FILE_REQUEST外只指向响应报文缓冲
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    // 除FILE_REQUEST外只有响应报文缓冲，HEAD请求去掉正文
+    if(m_method == HEAD)
+        m_write_idx = m_head_end;
+    add_iov(m_write_buf + head, m_write_idx - head);
+    return true;
+}
+
+// ETag与Last-Modified，客户端据此发起条件请求
+bool http_conn::add_validators(){
+    char date[64];
+    int len = make_http_date(date, sizeof(date), m_req->file_stat.st_mtime);
+    return add_field(HEADER_FRAGMENT("ETag:"), m_req->etag, strlen(m_req->etag)) &&
+           add_field(HEADER_FRAGMENT("Last-Modified:"), date, len);
+}
+
+// 未使用缓存报头的文件响应：类型、编码、校验信息
+bool http_conn::add_file_headers(long long content_len){
+    add_content_length(content_len);
+    add_content_type();
+    if(m_encoding)
+        add_field(HEADER_FRAGMENT("Content-Encoding:"), m_encoding, strlen(m_encoding));
+    // 压缩版本不支持范围请求
+    else
+        add_bytes("Accept-Ranges:bytes\r\n", 21);
+    add_validators();
+    add_cache_control();
+    add_linger();
+    return add_blank_line();
+}
+
+// 206响应：单段直接发送文件区间，多段按multipart/byteranges逐段发送
+bool http_conn::add_partial(int head){
+    static const char boundary[] = "TINYWEBSERVER_BYTERANGES";
+    add_status_line(206, partial_206_title);
+    add_validators();
+    add_cache_control();
+    if(m_range_count == 1){
+        const byte_range &r = m_req->ranges[0];
+        add_response("Content-Range:bytes %lld-%lld/%lld\r\n",
+                     (long long)r.start, (long long)r.last, (long long)m_req->file_stat.st_size);
+        add_content_type();
+        if(!add_headers(r.last - r.start + 1))
+            return false;
+        add_iov(m_write_buf + head, m_write_idx - head);
+        if(m_file_fd >= 0){
+            bytes_to_send += m_file_end - m_file_offset;
+            return true;
+        }
+        add_iov(m_file_address + r.start, r.last - r.start + 1);
+        return true;
+    }
+
+    // 先生成各段的分隔头以计算总长度
+    char parts[MAX_RANGES][128];
+    int part_len[MAX_RANGES];
+    long long total = 0;
+    for(int i = 0; i < m_range_count; ++i){
+        part_len[i] = snprintf(parts[i], sizeof(parts[i]), "\r\n--%s\r\nContent-Range:bytes %lld-%lld/%lld\r\n\r\n",
+                               boundary, (long long)m_req->ranges[i].start, (long long)m_req->ranges[i].last,
+                               (long long)m_req->file_stat.st_size);
+        total += part_len[i] + m_req->ranges[i].last - m_req->ranges[i].start + 1;
+    }
+    char tail[64];
+    int tail_len = snprintf(tail, sizeof(tail), "\r\n--%s--\r\n", boundary);
+    total += tail_len;
+
+    add_response("Content-Type:multipart/byteranges; boundary=%s\r\n", boundary);
+    if(!add_headers(total))
+        return false;
+    for(int i = 0; i < m_range_count; ++i){
+        int start = m_write_idx;
+        if(!add_response("%s", parts[i]))
+            return false;
+        // 第一段的分隔头与响应报头相邻，合并为一个元素
+        add_iov(m_write_buf + (i == 0 ? head : start), m_write_idx - (i == 0 ? head : start));
+        add_iov(m_file_address + m_req->ranges[i].start, m_req->ranges[i].last - m_req->ranges[i].start + 1);
+    }
+    int start = m_write_idx;
+    if(!add_response("%s", tail))
+        return false;
+    add_iov(m_write_buf + start, m_write_idx - start);
     return true;
 }
 
+void http_conn::add_iov(const char *base, size_t len){
+    if(len == 0)
+        return;
+    bytes_to_send += len;
+    if(m_iv_count > 0){
+        struct iovec &last = m_req->iv[m_iv_count - 1];
+        if((const char *)last.iov_base + last.iov_len == base){
+            last.iov_len += len;
+            return;
+        }
+    }
+    m_req->iv[m_iv_count].iov_base = (void *)base;
+    m_req->iv[m_iv_count].iov_len = len;
+    m_iv_count++;
+}
+
+void http_conn::finish_request(){
+    m_keep_alive = m_linger;
+    // 正文资源转交给待发送列表；零拷贝的文件结束本轮，留在当前字段
+    if(m_file_fd < 0 && (m_file_address || m_req->file || m_req->response || m_req->compressed)){
+        body_ref &body = m_req->bodies[m_body_count++];
+        body.map_addr = (m_req->file || m_req->compressed) ? 0 : m_file_address;
+        body.map_len = m_req->file_stat.st_size;
+        body.file = std::move(m_req->file);
+        body.response = std::move(m_req->response);
+        body.compressed = std::move(m_req->compressed);
+        m_req->file.reset();
+        m_req->response.reset();
+        m_req->compressed.reset();
+        m_file_address = 0;
+    }
+
+    // 消息体末尾的\0覆盖了下一个请求的首字节，恢复
+    if(m_string && m_checked_idx < m_read_idx)
+        m_read_buf[m_checked_idx] = m_body_end;
+    int left = m_read_idx - m_checked_idx;
+    if(left > 0)
+        memmove(m_read_buf, m_read_buf + m_checked_idx, left);
+    m_read_idx = left;
+    m_checked_idx = 0;
+    m_start_line = 0;
+
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_linger = false;
+    m_method = GET;
+    m_url = 0;
+    m_version = 0;
+    m_host = 0;
+    m_content_length = 0;
+    m_header_count = 0;
+    m_range_count = 0;
+    m_accept = 0;
+    m_encoding = nullptr;
+    m_req->variant_file[0] = '\0';
+    m_req->etag[0] = '\0';
+    m_rule = nullptr;
+    reset_body();
+    m_string = 0;
+    memset(m_req->real_file, 0, FILENAME_LEN);
+}
+
+// 只缓存来自文件缓存、仍然有效的小文件
+void http_conn::store_response(int head, const char *body, size_t len){
+    response_cache *cache = response_cache::get_instance();
+    if(!m_variant_final || !m_req->file || m_req->file->stale || !cache->cacheable(len))
+        return;
+    if(body){
+        cache->put(m_req->real_file, m_linger, m_accept, m_req->file, m_write_buf + head, m_write_idx - head, body, len);
+        return;
+    }
+    // 零拷贝模式下缓存未映射文件，读出正文
+    vector<char> buf(len);
+    if(pread(m_req->file->fd, buf.data(), buf.size(), 0) == (ssize_t)buf.size())
+        cache->put(m_req->real_file, m_linger, m_accept, m_req->file, m_write_buf + head, m_write_idx - head, buf.data(), buf.size());
+}
+
+// 解析请求并生成响应，不涉及事件注册
+// 读缓冲中可能有多个流水线请求，依次生成响应并合并到同一组向量中，由一次writev发出
+int http_conn::process_buffer(){
+    int count = 0;
+    while(count < MAX_PIPELINE){
+        HTTP_CODE read_ret = process_read();
+        // 请求不完整，或需交给线程池执行
+        if(read_ret == NO_REQUEST || read_ret == WORKER_REQUEST)
+            break;
+        if(!process_write(read_ret))
+            return -1;
+        ++count;
+        finish_request();
+        // 短连接、零拷贝正文和处理函数的正文必须是本轮最后一个响应；向量将满时留到下一轮
+        if(!m_keep_alive || m_file_fd >= 0 || read_ret == ROUTE_RESPONSE || m_iv_count + 2 > 2 * MAX_PIPELINE)
+            break;
+    }
+    if(count == 0)
+        return 0;
+    m_phase.store(PHASE_WRITE, std::memory_order_relaxed);
+    return 1;
+}
+
 // http处理
 void http_conn::process(){
-    HTTP_CODE read_ret = process_read();
+    int ret = process_buffer();
     // 请求不完整，继续注册读事件
-    if(read_ret == NO_REQUEST){
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+    if(ret == 0){
+        rearm(EPOLLIN);
         return;
     }
-    bool write_ret = process_write(read_ret);
-    if(!write_ret){
-        close_conn();
-    }
+    // 出错时不在工作线程中释放，shutdown后重新注册，事件循环收到EPOLLHUP再关闭
+    if(ret < 0)
+        shutdown(m_sockfd, SHUT_RDWR);
     // 准备好写缓冲，加入监听可写事件
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    rearm(EPOLLOUT);
+}
+
+void http_conn::rearm(int ev){
+    if(!m_pinned)
+        modfd(m_loop_epollfd, m_sockfd, ev, m_TRIGMode);
+}
+
+// 固定模式：连接只由所属循环线程访问，读到完整请求后直接生成响应并尝试发送
+// 发送不完时等待下一次EPOLLOUT边沿，期间新数据只读入缓冲，发完后再解析
+bool http_conn::process_inline(){
+    // 发完一批后缓冲区中可能还有流水线请求，继续处理
+    while(bytes_to_send == 0){
+        // 带处理函数的请求由事件循环交给线程池
+        if(m_offload)
+            return true;
+        if(m_checked_idx < m_read_idx){
+            int ret = process_buffer();
+            if(ret < 0)
+                return false;
+            if(ret > 0){
+                if(!write())
+                    return false;
+                continue;
+            }
+            if(m_offload)
+                return true;
+        }
+        // 读缓冲满时停止了读取，持久注册不会再通知，处理腾出空间后继续读
+        if(!m_read_full)
+            return true;
+        if(!read_once())
+            return false;
+    }
+    return true;
 }
\ No newline at end of file
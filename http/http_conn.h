@@ -20,21 +20,41 @@
 #include <error.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <vector>
+#include <atomic>
 
 #include "../locker/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../cache/file_cache.h"
+#include "../cache/response_cache.h"
+#include "../cache/compress_cache.h"
+#include "../buffer/buffer_pool.h"
+#include "http_token.h"
+#include "body_stream.h"
+#include "header_rules.h"
+#include "header_writer.h"
+#include "router.h"
 
 class http_conn{
 public:
     // 文件名称长度
     static const int FILENAME_LEN = 200;
-    // 读缓冲大小
+    // 读缓冲初始大小，不够时按倍数增长，上限为缓冲池最大级别
     static const int READ_BUFFER_SIZE = 2048;
-    // 写缓冲大小
+    // 写缓冲初始大小
     static const int WRITE_BUFFER_SIZE = 1024;
+    // 一次读入后最多连续处理的流水线请求数
+    static const int MAX_PIPELINE = 8;
+    // 报头表最多记录的请求头个数
+    static const int MAX_HEADERS = 32;
+    // 超过该长度的消息体流式交给消费者，不在读缓冲中积累
+    static const int BODY_INLINE_MAX = 8192;
+    // 一个范围请求最多的段数
+    static const int MAX_RANGES = 4;
     // 请求方法
     enum METHOD{
         GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT, PATH
@@ -47,7 +67,9 @@ public:
     };
     // 报文解析结果
     enum HTTP_CODE{
-        NO_REQUEST = 0, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION
+        NO_REQUEST = 0, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION,
+        PAYLOAD_TOO_LARGE, PARTIAL_CONTENT, NOT_MODIFIED, RANGE_NOT_SATISFIABLE, OPTIONS_REQUEST, METHOD_NOT_ALLOWED,
+        ROUTE_RESPONSE, WORKER_REQUEST
     };
     // 从状态机状态
     enum LINE_STATUS{
@@ -55,12 +77,18 @@ public:
     };
 
 public:
-    http_conn(){}
-    ~http_conn(){}
+    http_conn():m_read_buf(nullptr), m_read_size(0), m_write_buf(nullptr), m_write_size(0),
+                m_body_sink(nullptr), m_file_address(nullptr), m_file_fd(-1), m_iv_count(0), m_body_count(0),
+                m_req(nullptr){}
+    ~http_conn(){
+        reset_body();
+        release_buffers();
+    }
 
 public:
-    // 初始化连接
-    void init(int sockfd, const sockaddr_in &addr, const char *, int, int, string user, string passwd, string sqlname);
+    // 初始化连接，epollfd为连接所属事件循环，-1表示主循环，NO_EPOLL表示不经epoll（io_uring引擎）
+    // pinned表示连接固定在所属循环线程上处理，一次性注册持久的ET读写事件，不使用EPOLLONESHOT
+    void init(int sockfd, const sockaddr_in &addr, const char *, int, int, int epollfd = -1, bool pinned = false);
     // 关闭连接
     void close_conn(bool real_close=true);
     void process();
@@ -68,13 +96,55 @@ public:
     bool read_once();
     // 写响应报文
     bool write();
+    // 固定模式下在所属循环线程内处理已读入的请求并立即发送，返回false表示需要关闭连接
+    bool process_inline();
+    // 固定模式下已解析出带处理函数的请求，且前面的响应已发完，需交给线程池执行
+    // 线程池中调用process_buffer从该请求继续，处理函数阻塞在数据库上也不拖住循环线程
+    bool wants_worker() const{
+        return m_offload && bytes_to_send == 0;
+    }
+    // 以下接口不涉及epoll注册与收发，由io_uring等外部I/O引擎驱动
+    // 追加引擎收到的数据
+    bool read_from(const char *data, int len);
+    // 解析已读入的数据并生成响应：-1关闭连接，0请求不完整，1响应已就绪
+    int process_buffer();
+    // 待发送的向量
+    struct iovec* get_iv(int &count){
+        count = m_iv_count;
+        return m_req ? m_req->iv : nullptr;
+    }
+    // 已发送n字节，返回true表示本次响应全部发送完毕
+    bool on_sent(int n);
+    // 响应发送完毕后收尾，返回true表示长连接继续
+    bool finish_response();
+    // 读缓冲中还有未处理的流水线数据，需要再次process
+    bool has_buffered() const{
+        return m_read_idx > 0;
+    }
+    // 连接所处阶段，事件循环据此设置超时，可在其他线程读取
+    int timeout_phase() const{
+        return m_phase.load(std::memory_order_relaxed);
+    }
+    // 按名称查找请求头，不区分大小写，len返回值的长度，未找到返回nullptr
+    const char* get_header(const char *name, int &len) const;
+    // 按已识别的报头查找，省去名称比较
+    const char* get_header(http_token::HEADER id, int &len) const;
     sockaddr_in* get_address(){
         return &m_address;
     }
     // 初始化数据库读取表
     void initmysql_result(connection_pool *connPool);
-    int timer_flag;     // reactor是否处理数据
-    int improv;         // reactor是否处理失败
+    // 注册内置路由：页面跳转与登录注册，需在用户路由之前调用，同一路径可被用户覆盖
+    static void init_routes();
+    std::atomic<int> timer_flag;    // reactor读写失败，需要关闭连接
+    std::atomic<int> improv;        // reactor工作线程已处理完毕
+    http_conn *m_done_next;         // 完成队列链接指针
+    std::atomic<int> m_worker;      // 上次处理该连接的工作线程，工作窃取模式下优先投递给它
+    std::atomic<int> m_busy;        // 已投递线程池、尚未处理完的任务数
+    // 工作线程仍在处理，或reactor完成项尚未被事件循环取走，此时事件循环不能释放连接
+    bool in_worker() const{
+        return m_busy.load(std::memory_order_acquire) > 0 || improv.load(std::memory_order_acquire) == 1;
+    }
 
 private:
     void init();
@@ -83,74 +153,189 @@ private:
     // 向m_write_buf写入响应报文
     bool process_write(HTTP_CODE ret);
     // 主状态机解析请求行数据
-    HTTP_CODE parse_request_line(char *text);
+    HTTP_CODE parse_request_line(char *text, int len);
     // 主状态机解析请求头数据
-    HTTP_CODE parse_headers(char *text);
+    HTTP_CODE parse_headers(char *text, int len);
     // 主状态机解析请求内容
-    HTTP_CODE parse_content(char *text);
+    HTTP_CODE parse_content();
+    // 快速路径：请求一次到达时直接逐行解析，数据不足时停在完整行之后
+    HTTP_CODE parse_fast();
+    // 条件请求与范围请求，返回FILE_REQUEST、PARTIAL_CONTENT、NOT_MODIFIED或RANGE_NOT_SATISFIABLE
+    HTTP_CODE check_conditional();
+    HTTP_CODE parse_range(const char *text, int len);
+    // 按Accept-Encoding选择预先压缩的文件或压缩结果
+    void select_encoding();
+    // 零拷贝发送的文件区间
+    void set_file_range();
+    // 大消息体：按路由检查上限并创建消费者
+    HTTP_CODE start_body();
+    // 把已到达的消息体交给消费者并移出读缓冲
+    HTTP_CODE stream_content();
+    // 流式接收时读缓冲放不下need字节，先交给消费者腾出空间，返回false表示消息体出错
+    bool drain_body(int need);
+    // 消息体出错，响应后关闭连接
+    HTTP_CODE body_error(HTTP_CODE code);
+    // 释放消费者，清除消息体状态
+    void reset_body();
     // 生成响应报文
     HTTP_CODE do_request();
+    // 固定模式下带处理函数的路由不在循环线程执行，返回WORKER_REQUEST，其余直接do_request
+    HTTP_CODE dispatch_request();
     // 获得未解读数据位置
     //m_start_line是行在buffer中的起始位置，将该位置后面的数据赋给text
     //此时从状态机已提前将一行的末尾字符\r\n变为\0\0，所以text可以直接取出完整的行进行解析
     char* get_line(){return m_read_buf + m_start_line;};
     // 从状态机读取一行
     LINE_STATUS parse_line();
+    // 释放文件映射，零拷贝模式下关闭文件
     void unmap();
+    // 零拷贝发送一次：报头带MSG_MORE，正文sendfile
+    ssize_t send_file();
+    // 将刚生成的小文件响应加入响应缓存，body为正文，nullptr表示从文件读取
+    void store_response(int head, const char *body, size_t len);
+    // 追加一段待发送数据，与上一段相邻时合并
+    void add_iov(const char *base, size_t len);
+    // 响应的Content-Type，路径规则优先于扩展名
+    const char* content_type() const;
+    // 一个请求处理完毕：保留响应正文，剩余数据移到读缓冲头部，重置解析状态
+    void finish_request();
+    // 读缓冲至少还能再放need字节，必要时从缓冲池换更大的块并修正解析指针
+    bool reserve_read(int need);
+    // 写缓冲至少还能再放need字节，必要时换更大的块并修正指向写缓冲的向量
+    bool reserve_write(int need);
+    // 连接空闲时把读写缓冲和请求状态还给缓冲池
+    void release_buffers();
+    // 取用与归还请求状态块
+    bool acquire_state();
+    void release_state();
+    // 收到数据时更新连接阶段
+    void on_data();
+    // 重新注册EPOLLONESHOT事件，固定模式下注册是持久的，无需调用epoll_ctl
+    void rearm(int ev);
 
     // 生成具体响应报文
     bool add_response(const char *format, ...);
+    bool add_bytes(const char *data, int len);
+    bool add_field(header_writer::fragment name, const char *value, int len);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
+    bool add_headers(long long content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_content_length(long long content_length);
+    bool add_validators();
+    bool add_cache_control();
+    bool add_file_headers(long long content_len);
+    bool add_partial(int head);
     bool add_linger();
     bool add_blank_line();
 
 public:
+    static const int NO_EPOLL = -2;     // 连接不注册到epoll
     static int m_epollfd;       // epoll事件表
-    static int m_user_count;    // 客户数量
+    static int m_zero_copy;     // 静态文件发送方式，0 mmap+writev，1 sendfile
+    static int m_precompressed; // 是否发送同目录下预先压缩的.br/.zst/.gz文件
+    static int m_max_requests;  // 单个连接最多处理的请求数，0不限制
+    static std::atomic<int> m_user_count;    // 客户数量，多个反应堆线程并发修改
     MYSQL *mysql;               // 数据库连接
     int m_state;                // reactor区分读写任务，0读，1写
 
 private:
     int m_sockfd;               // 客户socket
+    int m_loop_epollfd;         // 所属事件循环的epoll句柄
+    bool m_pinned;              // 固定在所属循环线程，持久ET注册
+    bool m_offload;             // 固定模式下请求已解析，等待在线程池中执行do_request
     sockaddr_in m_address;      // 客户地址
-    char m_read_buf[READ_BUFFER_SIZE];
+    char *m_read_buf;           // 读缓冲，从缓冲池按需取用
+    int m_read_size;            // 读缓冲容量
     int m_read_idx;             // 已读数据结尾
     int m_checked_idx;          // 解析进行处
     int m_start_line;           // 解析开始处
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    bool m_read_full;           // ET模式读缓冲已满而停止读取，socket中可能还有数据
+    int m_request_count;        // 本连接已处理的请求数
+    std::atomic<int> m_phase;   // 连接所处阶段，CONN_PHASE
+    char *m_write_buf;          // 写缓冲，从缓冲池按需取用
+    int m_write_size;           // 写缓冲容量
     int m_write_idx;            // 已写数据结尾
+    int m_head_end;             // 最近一个响应报头的结尾，HEAD请求只发送到这里
     CHECK_STATE m_check_state;  // 主状态机状态
     METHOD m_method;            // 请求方法
 
     // 解析请求报文变量
-    char m_real_file[FILENAME_LEN]; // 实际文件路径
     char *m_url;
     char *m_version;
     char *m_host;
-    int m_content_length;
+    long long m_content_length;
+    bool m_has_length;          // 已收到Content-Length
+    bool m_chunked;             // 分块传输编码
+    bool m_expect_continue;     // 客户端等待100 Continue后再发送消息体
+    body_sink *m_body_sink;     // 流式接收消息体的消费者
+    chunked_decoder m_chunk;
+    long long m_body_limit;     // 当前url的消息体上限
+    long long m_body_received;  // 已交给消费者的字节数
+    HTTP_CODE m_body_status;    // NO_REQUEST接收中，GET_REQUEST完成，其余为错误
+    // 请求头在读缓冲中的位置，按偏移记录，缓冲区扩大后仍然有效
+    struct header_span{
+        int name_off;
+        int value_off;
+        uint16_t name_len;
+        uint16_t value_len;
+        http_token::HEADER id;  // 已识别报头的编号，未识别为H_UNKNOWN
+    };
+    int m_header_count;
     bool m_linger;          // 是否为长连接
 
     char *m_file_address;   // 服务器上文件指针
-    struct stat m_file_stat;// 文件信息结构体
-    struct iovec m_iv[2];   // 向量元素
+    int m_file_fd;          // 零拷贝模式下打开的文件，-1表示使用mmap
+    off_t m_file_offset;    // sendfile已发送到的文件偏移
+    off_t m_file_end;       // sendfile发送的结束偏移
+    // 范围请求的各段，闭区间
+    struct byte_range{
+        off_t start;
+        off_t last;
+    };
+    int m_range_count;
+    int m_accept;               // 可接受的内容编码掩码
+    const char *m_encoding;     // 发送的内容编码，nullptr为原文件
+    const header_rule *m_rule;  // 文件路径匹配的报头规则
+    bool m_variant_final;       // 所选版本不会因后台压缩完成而改变，可以进入响应缓存
     int m_iv_count;         // 向量元素个数
-    int cgi;                // 是否启用POST
+    // 已生成、待发送的流水线响应所引用的正文
+    struct body_ref{
+        char *map_addr;     // 自行映射的文件
+        size_t map_len;
+        shared_ptr<const file_entry> file;
+        shared_ptr<const response_entry> response;
+        shared_ptr<const compressed_entry> compressed;
+    };
+    int m_body_count;
+    // 请求与响应期间才用到的大块状态，收到数据时与读缓冲一起从缓冲池取用，空闲时归还
+    // 空闲的长连接只占槽位本身，MAX_FD个槽位不再按最大请求预留内存
+    struct request_state{
+        char real_file[FILENAME_LEN];   // 实际文件路径
+        char variant_file[FILENAME_LEN];    // 预先压缩文件的路径
+        char etag[64];              // 发送内容的ETag
+        header_span headers[MAX_HEADERS];
+        byte_range ranges[MAX_RANGES];
+        struct stat file_stat;      // 文件信息结构体
+        // 向量元素，每个响应报头和正文各一个，多段范围响应每段再多两个
+        struct iovec iv[2 * MAX_PIPELINE + 2 * MAX_RANGES];
+        body_ref bodies[MAX_PIPELINE];
+        shared_ptr<const file_entry> file;  // 命中文件缓存时持有的条目，fd与映射归缓存所有
+        shared_ptr<const response_entry> response;  // 命中响应缓存时持有的完整响应
+        shared_ptr<const compressed_entry> compressed;  // 发送内存中的压缩结果
+        route_response route;       // 处理函数生成的响应
+        int cap;                    // 所在缓冲池块的容量
+    };
+    request_state *m_req;   // 与读缓冲同时存在，m_read_buf非空时总是有效
+    bool m_keep_alive;      // 最后一个响应是否为长连接
+    char m_body_end;        // 消息体末尾被\0覆盖的字节，属于下一个流水线请求
     char *m_string;
     uint32_t bytes_to_send;      // 剩余发送字节
     uint32_t bytes_have_send;    // 已发送字节
     const char *doc_root;        // 资源根目录
 
-    map<string, string> m_users;    // 用户表
     int m_TRIGMode;         // ET模式
     int m_close_log;        // 是否关闭日志
-
-    char sql_user[100];     // 数据库用户名
-    char sql_passwd[100];   // 数据库密码
-    char sql_name[100];     // 数据库名
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef HTTP_TOKEN_H
+#define HTTP_TOKEN_H
+
+#include <strings.h>
+
+// 请求方法和报头名称的完美哈希表，编译期生成
+// 查找时对名称做一次不区分大小写的哈希，取槽位后再比较一次字符串，不分配内存
+namespace http_token{
+
+// 已识别的报头，新增时在header_names中按相同顺序加入名称
+enum HEADER{
+    H_UNKNOWN = -1,
+    H_CONNECTION = 0, H_CONTENT_LENGTH, H_HOST, H_CONTENT_TYPE, H_TRANSFER_ENCODING,
+    H_EXPECT, H_RANGE, H_IF_RANGE, H_IF_NONE_MATCH, H_IF_MODIFIED_SINCE,
+    H_ACCEPT_ENCODING, H_USER_AGENT, H_ACCEPT, H_COOKIE, H_REFERER, H_UPGRADE,
+    H_KEEP_ALIVE
+};
+
+constexpr const char *header_names[] = {
+    "connection", "content-length", "host", "content-type", "transfer-encoding",
+    "expect", "range", "if-range", "if-none-match", "if-modified-since",
+    "accept-encoding", "user-agent", "accept", "cookie", "referer", "upgrade",
+    "keep-alive"
+};
+static_assert(sizeof(header_names) / sizeof(header_names[0]) == H_KEEP_ALIVE + 1, "header_names must match HEADER");
+
+// 与http_conn::METHOD顺序一致
+constexpr const char *method_names[] = {
+    "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"
+};
+
+constexpr char lower(char c){
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+constexpr int length(const char *s){
+    int n = 0;
+    while(s[n])
+        ++n;
+    return n;
+}
+
+// 不区分大小写的FNV-1a
+constexpr unsigned hash(const char *s, int len, unsigned seed){
+    unsigned h = seed;
+    for(int i = 0; i < len; ++i)
+        h = (h ^ (unsigned char)lower(s[i])) * 16777619u;
+    return h;
+}
+
+// FNV低位混合不充分，折入高位再取槽位
+template<int SIZE>
+constexpr unsigned slot_of(unsigned h){
+    return (h ^ (h >> 15)) & (SIZE - 1);
+}
+
+// SIZE为2的幂，槽位存名称下标，-1为空
+template<int SIZE>
+struct table{
+    unsigned seed;
+    signed char slot[SIZE];
+};
+
+// 所有名称是否落在不同槽位
+template<int SIZE, int N>
+constexpr bool perfect(const char *const (&names)[N], unsigned seed){
+    bool used[SIZE] = {};
+    for(int i = 0; i < N; ++i){
+        unsigned s = slot_of<SIZE>(hash(names[i], length(names[i]), seed));
+        if(used[s])
+            return false;
+        used[s] = true;
+    }
+    return true;
+}
+
+// 从FNV初始值开始逐个尝试种子，直到无冲突
+template<int SIZE, int N>
+constexpr table<SIZE> build(const char *const (&names)[N]){
+    table<SIZE> t = {};
+    t.seed = 2166136261u;
+    while(!perfect<SIZE>(names, t.seed))
+        ++t.seed;
+    for(int i = 0; i < SIZE; ++i)
+        t.slot[i] = -1;
+    for(int i = 0; i < N; ++i)
+        t.slot[slot_of<SIZE>(hash(names[i], length(names[i]), t.seed))] = i;
+    return t;
+}
+
+constexpr table<64> header_table = build<64>(header_names);
+constexpr table<16> method_table = build<16>(method_names);
+
+template<int SIZE, int N>
+inline int lookup(const table<SIZE> &t, const char *const (&names)[N], const char *s, int len){
+    int i = t.slot[slot_of<SIZE>(hash(s, len, t.seed))];
+    if(i < 0 || length(names[i]) != len || strncasecmp(names[i], s, len) != 0)
+        return -1;
+    return i;
+}
+
+// 查找报头名称，未识别返回H_UNKNOWN
+inline HEADER find_header(const char *name, int len){
+    return (HEADER)lookup(header_table, header_names, name, len);
+}
+
+// 查找请求方法，未识别返回-1
+inline int find_method(const char *name, int len){
+    return lookup(method_table, method_names, name, len);
+}
+
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef MIME_TYPE_H
+#define MIME_TYPE_H
+
+#include <cstring>
+
+#include "http_token.h"
+
+// 扩展名到Content-Type的映射，与请求方法、报头名称相同，编译期生成完美哈希表
+namespace mime{
+
+constexpr const char *exts[] = {
+    "html", "htm", "css", "js", "mjs", "json", "xml", "txt", "csv", "md",
+    "png", "jpg", "jpeg", "gif", "ico", "svg", "webp", "avif", "bmp",
+    "mp4", "webm", "ogv", "mp3", "ogg", "wav", "flac",
+    "woff", "woff2", "ttf", "otf", "wasm", "pdf", "zip", "gz", "tar"
+};
+
+constexpr const char *types[] = {
+    "text/html", "text/html", "text/css", "application/javascript", "application/javascript",
+    "application/json", "application/xml", "text/plain", "text/csv", "text/markdown",
+    "image/png", "image/jpeg", "image/jpeg", "image/gif", "image/x-icon", "image/svg+xml",
+    "image/webp", "image/avif", "image/bmp",
+    "video/mp4", "video/webm", "video/ogg", "audio/mpeg", "audio/ogg", "audio/wav", "audio/flac",
+    "font/woff", "font/woff2", "font/ttf", "font/otf", "application/wasm", "application/pdf",
+    "application/zip", "application/gzip", "application/x-tar"
+};
+static_assert(sizeof(exts) == sizeof(types), "exts must match types");
+
+constexpr http_token::table<128> table = http_token::build<128>(exts);
+
+}
+
+// 按扩展名确定Content-Type，不认识的扩展名按二进制流处理
+inline const char* mime_type(const char *path){
+    const char *dot = strrchr(path, '.');
+    if(dot && !strchr(dot, '/')){
+        int i = http_token::lookup(mime::table, mime::exts, dot + 1, strlen(dot + 1));
+        if(i >= 0)
+            return mime::types[i];
+    }
+    return "application/octet-stream";
+}
+
+#endif
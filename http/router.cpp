@@ -0,0 +1,75 @@
+#include "router.h"
+
+router::router(){
+    node root = {'\0', -1, -1, -1, -1};
+    m_nodes.push_back(root);
+}
+
+void router::add_exact(const char *path, int methods, route_handler handler){
+    route r;
+    r.path = path;
+    r.prefix = false;
+    r.methods = methods;
+    r.handler = handler;
+    add(r);
+}
+
+void router::add_prefix(const char *prefix, int methods, route_handler handler){
+    route r;
+    r.path = prefix;
+    r.prefix = true;
+    r.methods = methods;
+    r.handler = handler;
+    add(r);
+}
+
+void router::add_alias(const char *path, const char *file){
+    route r;
+    r.path = path;
+    r.prefix = false;
+    r.methods = ROUTE_GET | ROUTE_POST | ROUTE_HEAD;
+    r.file = file;
+    add(r);
+}
+
+void router::add(const route &r){
+    int n = 0;
+    for(size_t i = 0; i < r.path.size(); ++i){
+        char ch = r.path[i];
+        int c = m_nodes[n].child;
+        while(c >= 0 && m_nodes[c].ch != ch)
+            c = m_nodes[c].sibling;
+        if(c < 0){
+            node child = {ch, -1, m_nodes[n].child, -1, -1};
+            c = m_nodes.size();
+            m_nodes.push_back(child);
+            m_nodes[n].child = c;
+        }
+        n = c;
+    }
+    int index = m_routes.size();
+    m_routes.push_back(r);
+    if(r.prefix)
+        m_nodes[n].prefix = index;
+    else
+        m_nodes[n].exact = index;
+}
+
+const route* router::match(const char *url) const{
+    int n = 0;
+    int best = m_nodes[0].prefix;
+    for(const char *p = url; *p && *p != '?'; ++p){
+        int c = m_nodes[n].child;
+        while(c >= 0 && m_nodes[c].ch != *p)
+            c = m_nodes[c].sibling;
+        // 没有更长的路径，返回已经过的最长前缀
+        if(c < 0)
+            return best >= 0 ? &m_routes[best] : nullptr;
+        n = c;
+        if(m_nodes[n].prefix >= 0)
+            best = m_nodes[n].prefix;
+    }
+    if(m_nodes[n].exact >= 0)
+        return &m_routes[m_nodes[n].exact];
+    return best >= 0 ? &m_routes[best] : nullptr;
+}
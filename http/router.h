@@ -0,0 +1,102 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// 只用到连接指针，前向声明即可，路由表与基准程序不依赖MySQL头文件；
+// 已包含mysql.h时沿用其中的定义（MySQL 8把结构体改名为MYSQL，重复声明会冲突）
+#ifndef _mysql_h
+typedef struct st_mysql MYSQL;
+#endif
+
+using namespace std;
+
+class body_sink;
+
+// 路由允许的请求方法，位序与http_token::method_names一致
+enum ROUTE_METHOD{
+    ROUTE_GET = 1 << 0,
+    ROUTE_POST = 1 << 1,
+    ROUTE_HEAD = 1 << 2,
+    ROUTE_ANY = -1
+};
+
+// 交给处理函数的请求
+struct route_request{
+    int method;             // http_token::find_method的编号
+    const char *url;
+    const char *body;       // 读缓冲中的消息体，流式接收的大消息体为nullptr
+    long long body_len;     // 消息体长度，流式接收时为已交给消费者的字节数
+    MYSQL *mysql;           // 本次请求取得的数据库连接
+    body_sink *sink;        // 流式接收消息体的消费者，已接收完毕，未流式接收为nullptr
+    int body_fd;            // 消费者为默认的溢出文件时其fd，用pread从0读取body_len字节，否则为-1
+};
+
+// 处理函数生成的响应，不经过文件系统
+struct route_response{
+    int status;                 // 状态码
+    const char *title;          // 状态短语，状态码不在常用表中时使用
+    const char *content_type;
+    string body;                // 响应正文，流水线上的请求复用同一个对象，容量保留
+    const char *file;           // 非空时改为发送资源根目录下的该文件
+
+    void reset(){
+        status = 200;
+        title = "OK";
+        content_type = "text/html";
+        body.clear();
+        file = nullptr;
+    }
+};
+
+// 返回false表示处理失败，响应500
+typedef function<bool(const route_request &req, route_response &res)> route_handler;
+
+struct route{
+    string path;
+    bool prefix;            // 前缀匹配
+    int methods;            // ROUTE_METHOD位掩码
+    route_handler handler;  // 为空表示文件别名
+    string file;            // 别名指向的文件，相对资源根目录
+};
+
+// 按url分发的路由表：精确路径、前缀与文件别名，字节trie查找
+// 精确路径优先于前缀，多个前缀取最长的，查询串不参与匹配
+class router{
+public:
+    static router* get_instance(){
+        static router instance;
+        return &instance;
+    }
+
+    // 注册路由，需在服务启动前完成，运行期间只读；同一路径后注册的覆盖先注册的
+    void add_exact(const char *path, int methods, route_handler handler);
+    void add_prefix(const char *prefix, int methods, route_handler handler);
+    void add_alias(const char *path, const char *file);
+    // 查找url对应的路由，不分配内存，未匹配返回nullptr
+    const route* match(const char *url) const;
+
+private:
+    router();
+    ~router(){}
+    router(const router&) = delete;
+    router& operator=(const router&) = delete;
+
+    void add(const route &r);
+
+private:
+    // trie节点，子节点以兄弟链表连接
+    struct node{
+        char ch;
+        int child;      // 第一个子节点，-1表示没有
+        int sibling;    // 下一个兄弟节点
+        int exact;      // 在此结束的精确路由，-1表示没有
+        int prefix;     // 在此结束的前缀路由
+    };
+    vector<node> m_nodes;
+    vector<route> m_routes;
+};
+
+#endif
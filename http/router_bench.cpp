@@ -0,0 +1,146 @@
+// 路由查找的微基准：约50条精确与前缀路由，比较逐条strncmp扫描、unordered_map与字节trie的耗时和内存分配次数
+// 编译：g++ -O2 -std=c++14 router_bench.cpp router.cpp -o router_bench
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "router.h"
+
+using namespace std;
+
+// 统计查找过程中的堆分配
+static long long alloc_count;
+
+void* operator new(size_t size){
+    ++alloc_count;
+    void *p = malloc(size ? size : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept{
+    free(p);
+}
+
+static bool nop(const route_request &, route_response &){
+    return true;
+}
+
+static vector<string> exacts;
+static vector<string> prefixes;
+static vector<string> urls;
+
+// 逐条比较，精确优先，前缀取最长
+static const string* linear_match(const char *url){
+    size_t len = strcspn(url, "?");
+    for(size_t i = 0; i < exacts.size(); ++i)
+        if(exacts[i].size() == len && strncmp(url, exacts[i].c_str(), len) == 0)
+            return &exacts[i];
+    const string *best = nullptr;
+    for(size_t i = 0; i < prefixes.size(); ++i)
+        if(prefixes[i].size() <= len && strncmp(url, prefixes[i].c_str(), prefixes[i].size()) == 0 &&
+           (!best || prefixes[i].size() > best->size()))
+            best = &prefixes[i];
+    return best;
+}
+
+// 精确路径查哈希表，前缀仍需逐条比较，查询前要先构造string
+static unordered_map<string, const string*> exact_map;
+
+static const string* hash_match(const char *url){
+    string path(url, strcspn(url, "?"));
+    unordered_map<string, const string*>::iterator it = exact_map.find(path);
+    if(it != exact_map.end())
+        return it->second;
+    const string *best = nullptr;
+    for(size_t i = 0; i < prefixes.size(); ++i)
+        if(path.compare(0, prefixes[i].size(), prefixes[i]) == 0 && (!best || prefixes[i].size() > best->size()))
+            best = &prefixes[i];
+    return best;
+}
+
+static const string* trie_match(const char *url){
+    const route *r = router::get_instance()->match(url);
+    return r ? &r->path : nullptr;
+}
+
+static void run(const char *name, const string* (*match)(const char *), int rounds){
+    volatile size_t sink = 0;
+    long long allocs = alloc_count;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < rounds; ++i){
+        const string *r = match(urls[i % urls.size()].c_str());
+        sink += r ? r->size() : 0;
+    }
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    allocs = alloc_count - allocs;
+    double ns = chrono::duration_cast<chrono::nanoseconds>(stop - start).count();
+    cout << name << ":\t" << ns / rounds << " ns/lookup\t" << (double)allocs / rounds << " allocs/lookup" << endl;
+}
+
+int main(int argc, char *argv[]){
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000000;
+    router *r = router::get_instance();
+    const char *pages[] = {"/0", "/1", "/2CGISQL.cgi", "/3CGISQL.cgi", "/5", "/6", "/7", "/judge.html"};
+    for(size_t i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i)
+        exacts.push_back(pages[i]);
+    char buf[64];
+    for(int i = 0; i < 22; ++i){
+        snprintf(buf, sizeof(buf), "/api/v1/resource%d", i);
+        exacts.push_back(buf);
+    }
+    for(int i = 0; i < 20; ++i){
+        snprintf(buf, sizeof(buf), "/static/group%d/", i);
+        prefixes.push_back(buf);
+    }
+    prefixes.push_back("/api/");
+    prefixes.push_back("/static/");
+    // 先填满再取指针，避免扩容后失效
+    for(size_t i = 0; i < exacts.size(); ++i){
+        r->add_exact(exacts[i].c_str(), ROUTE_ANY, nop);
+        exact_map[exacts[i]] = &exacts[i];
+    }
+    for(size_t i = 0; i < prefixes.size(); ++i)
+        r->add_prefix(prefixes[i].c_str(), ROUTE_ANY, nop);
+
+    // 命中精确、命中前缀与未命中的url混合
+    for(int i = 0; i < 64; ++i){
+        switch(i % 4){
+            case 0: snprintf(buf, sizeof(buf), "/api/v1/resource%d?id=%d", i % 22, i); break;
+            case 1: snprintf(buf, sizeof(buf), "/static/group%d/img/%d.png", i % 20, i); break;
+            case 2: snprintf(buf, sizeof(buf), "/api/v2/item%d", i); break;
+            default: snprintf(buf, sizeof(buf), "/picture%d.html", i); break;
+        }
+        urls.push_back(buf);
+    }
+    urls.push_back("/2CGISQL.cgi");
+    urls.push_back("/5");
+
+    // 三种实现的结果应一致
+    for(size_t i = 0; i < urls.size(); ++i){
+        const string *a = linear_match(urls[i].c_str());
+        const string *b = hash_match(urls[i].c_str());
+        const string *c = trie_match(urls[i].c_str());
+        string sa = a ? *a : "", sb = b ? *b : "", sc = c ? *c : "";
+        if(sa != sb || sa != sc){
+            cout << "mismatch on " << urls[i] << ": " << sa << " " << sb << " " << sc << endl;
+            return 1;
+        }
+    }
+
+    cout << exacts.size() + prefixes.size() << " routes, " << rounds << " rounds" << endl;
+    run("linear", linear_match, rounds);
+    run("unordered_map", hash_match, rounds);
+    run("trie", trie_match, rounds);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+// 请求报文的字节扫描：一次比较16(SSE2)或32(AVX2)字节，查找行尾与分隔符
+// x86下运行时检测CPU选择实现，其他平台使用逐字节实现；AVX2版本供长数据和基准测试使用
+namespace simd_scan{
+
+// 在[begin, end)中查找第一个等于a或b的字节，找不到返回end
+typedef const char* (*find2_func)(const char *begin, const char *end, char a, char b);
+
+const char* find2_scalar(const char *begin, const char *end, char a, char b);
+#if defined(__x86_64__) || defined(__i386__)
+const char* find2_sse2(const char *begin, const char *end, char a, char b);
+const char* find2_avx2(const char *begin, const char *end, char a, char b);
+#endif
+
+// 当前CPU可用的最快实现
+extern find2_func find2;
+// 所选实现的名称
+const char* impl_name();
+
+// 行尾：\r或\n
+inline const char* find_eol(const char *begin, const char *end){
+    return find2(begin, end, '\r', '\n');
+}
+// 单个字节
+inline const char* find_char(const char *begin, const char *end, char c){
+    return find2(begin, end, c, c);
+}
+// 空格或制表符
+inline const char* find_space(const char *begin, const char *end){
+    return find2(begin, end, ' ', '\t');
+}
+
+}
+
+#endif
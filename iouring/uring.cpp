@@ -0,0 +1,250 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "uring.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args){
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// 本引擎用到的操作码
+static const int needed_ops[] = {
+    IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_WRITEV, IORING_OP_POLL_ADD, IORING_OP_PROVIDE_BUFFERS
+};
+
+// 在回环地址上监听一个临时端口，提交多shot accept后发起一次连接
+// 不支持多shot的内核(5.19之前)不认识accept的ioprio标志，立即以-EINVAL完成
+static bool probe_multishot_accept(uring &ring){
+    bool ok = false;
+    int listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int clientfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(listenfd >= 0 && clientfd >= 0 &&
+       bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+       getsockname(listenfd, (struct sockaddr *)&addr, &len) == 0 &&
+       listen(listenfd, 1) == 0){
+        struct io_uring_sqe *sqe = ring.get_sqe();
+        uring::prep_accept_multishot(sqe, listenfd, 0);
+        if(ring.submit() >= 0 && connect(clientfd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+           ring.submit_and_wait(1) >= 0){
+            struct io_uring_cqe *cqe = ring.peek_cqe();
+            if(cqe){
+                ok = cqe->res >= 0 && (cqe->flags & IORING_CQE_F_MORE);
+                if(cqe->res >= 0)
+                    close(cqe->res);
+                ring.cqe_seen();
+            }
+        }
+    }
+    if(clientfd >= 0)
+        close(clientfd);
+    if(listenfd >= 0)
+        close(listenfd);
+    return ok;
+}
+
+// IOSQE_CQE_SKIP_SUCCESS(5.17)有特性位；各操作码用IORING_REGISTER_PROBE确认；多shot accept(5.19)没有特性位，试探一次
+bool uring::probe(){
+    uring ring;
+    if(!ring.init(8))
+        return false;
+    if(!(ring.m_features & IORING_FEAT_CQE_SKIP))
+        return false;
+
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *pr = (struct io_uring_probe *)calloc(1, len);
+    if(!pr)
+        return false;
+    bool ok = sys_io_uring_register(ring.m_ring_fd, IORING_REGISTER_PROBE, pr, 256) == 0;
+    for(size_t i = 0; ok && i < sizeof(needed_ops) / sizeof(needed_ops[0]); ++i){
+        int op = needed_ops[i];
+        ok = op < pr->ops_len && (pr->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(pr);
+    return ok && probe_multishot_accept(ring);
+}
+
+uring::uring(){
+    m_ring_fd = -1;
+    m_features = 0;
+    m_sq_ptr = MAP_FAILED;
+    m_cq_ptr = MAP_FAILED;
+    m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    m_sq_len = 0;
+    m_cq_len = 0;
+    m_sqes_len = 0;
+    m_sqe_head = 0;
+    m_sqe_tail = 0;
+    m_sq_entries = 0;
+}
+
+uring::~uring(){
+    if(m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_len);
+    if(m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_len);
+    if(m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_len);
+    if(m_ring_fd != -1)
+        close(m_ring_fd);
+}
+
+// 创建ring，映射SQ环、CQ环和SQE数组
+bool uring::init(unsigned entries){
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_ring_fd = sys_io_uring_setup(entries, &p);
+    if(m_ring_fd < 0){
+        m_ring_fd = -1;
+        return false;
+    }
+    m_features = p.features;
+
+    m_sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    // 新内核SQ与CQ可以共用一次映射
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        if(m_cq_len > m_sq_len)
+            m_sq_len = m_cq_len;
+        m_cq_len = m_sq_len;
+    }
+
+    m_sq_ptr = mmap(0, m_sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ptr == MAP_FAILED)
+        return false;
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        m_cq_ptr = m_sq_ptr;
+    }
+    else{
+        m_cq_ptr = mmap(0, m_cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+    m_sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(0, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED)
+        return false;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+    m_sq_entries = p.sq_entries;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+struct io_uring_sqe* uring::get_sqe(){
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    // SQ已满，先把已填写的提交给内核
+    if(m_sqe_tail - head >= m_sq_entries){
+        submit();
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if(m_sqe_tail - head >= m_sq_entries)
+            return nullptr;
+    }
+    struct io_uring_sqe *sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    m_sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// 发布已填写的SQE，一次io_uring_enter批量提交并收割
+int uring::submit_and_wait(unsigned wait_nr){
+    unsigned tail = *m_sq_tail;
+    while(m_sqe_head != m_sqe_tail){
+        m_sq_array[tail & *m_sq_mask] = m_sqe_head & *m_sq_mask;
+        tail++;
+        m_sqe_head++;
+    }
+    // release：SQE内容先于tail对内核可见
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+    // 包括之前未被内核取走的SQE
+    unsigned to_submit = tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+
+    if(to_submit == 0 && wait_nr == 0)
+        return 0;
+    int ret;
+    do{
+        ret = sys_io_uring_enter(m_ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    }while(ret < 0 && errno == EINTR && wait_nr == 0);
+    return ret;
+}
+
+struct io_uring_cqe* uring::peek_cqe(){
+    unsigned head = *m_cq_head;
+    // acquire：读到tail之后CQE内容可见
+    if(head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return nullptr;
+    return &m_cqes[head & *m_cq_mask];
+}
+
+void uring::cqe_seen(){
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void uring::prep_rw(int op, struct io_uring_sqe *sqe, int fd, const void *addr, unsigned len, uint64_t offset){
+    sqe->opcode = (uint8_t)op;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+}
+
+// 多shot accept：一次提交持续产生新连接，CQE不带IORING_CQE_F_MORE时需要重新提交
+void uring::prep_accept_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data){
+    prep_rw(IORING_OP_ACCEPT, sqe, fd, nullptr, 0, 0);
+    sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+// 从provided buffer组中由内核挑选缓冲区接收，CQE的flags高位带回缓冲区编号
+void uring::prep_recv_select(struct io_uring_sqe *sqe, int fd, unsigned len, int buf_group, uint64_t user_data){
+    prep_rw(IORING_OP_RECV, sqe, fd, nullptr, len, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = (uint16_t)buf_group;
+    sqe->user_data = user_data;
+}
+
+// 单次poll，就绪后完成；eventfd、timerfd是非阻塞的，直接提交read会立即以-EAGAIN完成
+void uring::prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events, uint64_t user_data){
+    prep_rw(IORING_OP_POLL_ADD, sqe, fd, nullptr, 0, 0);
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_writev(struct io_uring_sqe *sqe, int fd, const struct iovec *iov, unsigned count, uint64_t user_data){
+    prep_rw(IORING_OP_WRITEV, sqe, fd, iov, count, 0);
+    sqe->user_data = user_data;
+}
+
+// 向缓冲区组提供nr个长度为len的连续缓冲区，编号从bid开始
+void uring::prep_provide_buffers(struct io_uring_sqe *sqe, void *addr, int len, int nr, int buf_group, int bid, uint64_t user_data){
+    prep_rw(IORING_OP_PROVIDE_BUFFERS, sqe, nr, addr, len, bid);
+    sqe->buf_group = (uint16_t)buf_group;
+    sqe->user_data = user_data;
+}
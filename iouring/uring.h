@@ -0,0 +1,72 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <string.h>
+
+// io_uring的最小封装，直接使用系统调用，不依赖liburing
+// 提交队列(SQ)由本线程填写，完成队列(CQ)由本线程消费，对象不是线程安全的
+class uring{
+public:
+    uring();
+    ~uring();
+
+    // 检查本引擎依赖的内核特性，缺少任何一项返回false，调用方退回epoll
+    static bool probe();
+    // 创建ring并映射SQ/CQ
+    bool init(unsigned entries);
+    // 取一个空闲SQE，SQ已满时先提交再取
+    struct io_uring_sqe* get_sqe();
+    // 提交所有已填写的SQE，并至少等待wait_nr个完成事件
+    int submit_and_wait(unsigned wait_nr);
+    int submit(){
+        return submit_and_wait(0);
+    }
+    // 取下一个完成事件，没有则返回nullptr
+    struct io_uring_cqe* peek_cqe();
+    // 标记当前完成事件已处理
+    void cqe_seen();
+
+    // 准备各类请求，user_data由调用方编码
+    static void prep_accept_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+    static void prep_recv_select(struct io_uring_sqe *sqe, int fd, unsigned len, int buf_group, uint64_t user_data);
+    static void prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events, uint64_t user_data);
+    static void prep_writev(struct io_uring_sqe *sqe, int fd, const struct iovec *iov, unsigned count, uint64_t user_data);
+    static void prep_provide_buffers(struct io_uring_sqe *sqe, void *addr, int len, int nr, int buf_group, int bid, uint64_t user_data);
+
+private:
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    static void prep_rw(int op, struct io_uring_sqe *sqe, int fd, const void *addr, unsigned len, uint64_t offset);
+
+    int m_ring_fd;
+    unsigned m_features;        // io_uring_setup返回的IORING_FEAT_*
+
+    // 提交队列
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    struct io_uring_sqe *m_sqes;
+    unsigned m_sqe_head;        // 已交给内核的位置
+    unsigned m_sqe_tail;        // 已填写的位置
+    unsigned m_sq_entries;
+
+    // 完成队列
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+
+    void *m_sq_ptr;
+    size_t m_sq_len;
+    void *m_cq_ptr;
+    size_t m_cq_len;
+    size_t m_sqes_len;
+};
+
+#endif
@@ -4,6 +4,12 @@
 #include <exception>    // std异常
 #include <pthread.h>    // 线程接口，提供互斥锁，条件变量
 #include <semaphore.h>  // 信号量
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>    // 无锁结构的休眠与唤醒
 
 class semaphore{
 public:
@@ -27,6 +33,18 @@ public:
     bool wait(){
         return sem_wait(&m_sem) == 0;
     }
+    // 最多等待ms毫秒，超时返回false
+    bool timewait(int ms){
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += ms / 1000;
+        t.tv_nsec += (long)(ms % 1000) * 1000000;
+        if(t.tv_nsec >= 1000000000){
+            t.tv_sec += 1;
+            t.tv_nsec -= 1000000000;
+        }
+        return sem_timedwait(&m_sem, &t) == 0;
+    }
     // 内部调用了 sem_post 函数，该函数将信号量的值增加
     bool post(){
         return sem_post(&m_sem)  == 0;
@@ -97,4 +115,31 @@ private:
     pthread_cond_t m_cond;
 
 };
-#endif
\ No newline at end of file
+// futex等待字：等待方先取序号再检查条件，条件不满足才休眠；唤醒方改变条件后递增序号再唤醒
+// 检查条件与休眠之间发生的唤醒会使序号变化，wait立即返回，不会丢失
+class futex_word{
+public:
+    futex_word():m_seq(0){}
+
+    uint32_t prepare(){
+        return m_seq.load(std::memory_order_acquire);
+    }
+    // 序号仍为key时休眠，timeout_ms<0时不限时；可能虚假返回，调用方需重新检查条件
+    void wait(uint32_t key, int timeout_ms = -1){
+        struct timespec t;
+        t.tv_sec = timeout_ms / 1000;
+        t.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_seq), FUTEX_WAIT_PRIVATE, key,
+                timeout_ms < 0 ? nullptr : &t, nullptr, 0);
+    }
+    // 唤醒至多n个等待者
+    void wake(int n = 1){
+        m_seq.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_seq), FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+    }
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+    std::atomic<uint32_t> m_seq;
+};
+#endif
@@ -33,6 +33,8 @@ private:
 
     // 线程工作函数，静态函数防止this指针
     static void* flush_log_thread(void *args){
+        // 线程命名，top -H与perf中可区分
+        pthread_setname_np(pthread_self(), "log-flush");
         Log::get_instance()->async_write_log();
         return nullptr;
     }
@@ -0,0 +1,90 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "event_loop.h"
+#include "../log/log.h"
+
+event_loop::event_loop(){
+    m_id = -1;
+    m_close_log = 1;
+    m_wakeupfd = -1;
+    m_stop = false;
+    m_running = false;
+}
+
+event_loop::~event_loop(){
+    stop();
+    if(m_wakeupfd != -1)
+        close(m_wakeupfd);
+}
+
+void event_loop::init_wakeup(int id, int close_log){
+    m_id = id;
+    m_close_log = close_log;
+    m_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(m_wakeupfd != -1);
+}
+
+bool event_loop::start(){
+    if(pthread_create(&m_thread, NULL, worker, this) != 0){
+        return false;
+    }
+    m_running = true;
+    return true;
+}
+
+void event_loop::stop(){
+    if(!m_running)
+        return;
+    m_stop = true;
+    uint64_t one = 1;
+    ::write(m_wakeupfd, &one, sizeof(one));
+    pthread_join(m_thread, NULL);
+    m_running = false;
+}
+
+void* event_loop::worker(void *arg){
+    event_loop *loop = (event_loop *)arg;
+    loop->run();
+    return nullptr;
+}
+
+// 主反应堆线程调用：放入待接管队列并唤醒循环线程
+bool event_loop::dispatch(int connfd, const sockaddr_in &client_address){
+    m_lock.lock();
+    bool need_wakeup = m_pending.empty();
+    m_pending.push_back(make_pair(connfd, client_address));
+    m_lock.unlock();
+
+    // 队列原本非空说明已经有一次未处理的唤醒，无需重复写eventfd
+    if(need_wakeup){
+        uint64_t one = 1;
+        if(::write(m_wakeupfd, &one, sizeof(one)) < 0 && errno != EAGAIN){
+            LOG_ERROR("event loop %d wakeup error:%d", m_id, errno);
+            // 唤醒失败时把连接从队列取回，由调用方关闭；已被循环线程取走的照常由它处理
+            bool taken = true;
+            m_lock.lock();
+            for(size_t i = 0; i < m_pending.size(); ++i){
+                if(m_pending[i].first == connfd){
+                    m_pending.erase(m_pending.begin() + i);
+                    taken = false;
+                    break;
+                }
+            }
+            m_lock.unlock();
+            return taken;
+        }
+    }
+    return true;
+}
+
+void event_loop::take_pending(vector<pair<int, sockaddr_in>> &pending){
+    uint64_t cnt;
+    while(read(m_wakeupfd, &cnt, sizeof(cnt)) > 0);
+
+    m_lock.lock();
+    pending.swap(m_pending);
+    m_lock.unlock();
+}
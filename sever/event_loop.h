@@ -0,0 +1,52 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <vector>
+#include <atomic>
+
+#include "../locker/locker.h"
+
+using namespace std;
+
+// 子事件循环的公共部分：独占一个线程，主反应堆把新连接投递过来，之后连接的读写与超时都只在该线程处理
+// I/O引擎由子类实现：sub_reactor基于epoll，uring_loop基于io_uring
+class event_loop{
+public:
+    event_loop();
+    virtual ~event_loop();
+
+    // SO_REUSEPORT模式下本循环独占的监听套接字，需在start之前设置
+    virtual void set_listenfd(int listenfd, int listen_trig_mode) = 0;
+    // 创建线程，进入事件循环
+    bool start();
+    // 通知线程退出并回收，子类析构时先调用，线程不再访问子类成员
+    void stop();
+    // 主反应堆调用，将新连接交给本循环，线程安全；返回false时连接未被接管，由调用方关闭
+    bool dispatch(int connfd, const sockaddr_in &client_address);
+
+protected:
+    // 线程主体，m_stop置位后返回
+    virtual void run() = 0;
+    // 创建唤醒用的eventfd，子类初始化时调用
+    void init_wakeup(int id, int close_log);
+    // 清空唤醒计数，取出全部待接管的连接
+    void take_pending(vector<pair<int, sockaddr_in>> &pending);
+
+    int m_id;                   // 循环编号
+    int m_close_log;            // 关闭日志
+    int m_wakeupfd;             // eventfd，投递新连接或退出时唤醒
+    atomic<bool> m_stop;        // 退出标志
+
+private:
+    // 线程运行函数，静态函数避免this指针
+    static void* worker(void *arg);
+
+    mutexlocker m_lock;                         // 保护待接管连接队列
+    vector<pair<int, sockaddr_in>> m_pending;   // 主反应堆投递、尚未接管的连接
+    pthread_t m_thread;
+    bool m_running;
+};
+
+#endif
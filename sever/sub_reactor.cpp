@@ -0,0 +1,306 @@
+#include <sys/timerfd.h>
+
+#include "websever.h"
+#include "sub_reactor.h"
+#include "../threadpool/thread_affinity.h"
+
+// 定时器回调没有this指针，每个子反应堆线程记录自己的循环
+static thread_local sub_reactor *t_reactor = nullptr;
+
+sub_reactor::sub_reactor(){
+    m_listenfd = -1;
+    m_listen_trig_mode = 0;
+    m_epollfd = -1;
+    m_timerfd = -1;
+    events = nullptr;
+}
+
+sub_reactor::~sub_reactor(){
+    stop();
+    if(m_timerfd != -1)
+        close(m_timerfd);
+    if(m_listenfd != -1)
+        close(m_listenfd);
+    if(m_epollfd != -1)
+        close(m_epollfd);
+    numa_free(events, sizeof(epoll_event) * MAX_EVENT_NUMBER);
+}
+
+// 初始化子反应堆：创建epoll句柄，注册唤醒eventfd和定时timerfd
+void sub_reactor::init(int id, http_conn *users, client_data *users_timer, threadpool<http_conn> *pool,
+                       const char *root, int conn_trig_mode, int close_log, int timeslot, int conn_pinned){
+    this->users = users;
+    this->users_timer = users_timer;
+    m_pool = pool;
+    m_root = root;
+    m_conn_trig_mode = conn_trig_mode;
+    m_conn_pinned = conn_pinned;
+    m_timeslot = timeslot;
+
+    m_epollfd = epoll_create(5);
+    assert(m_epollfd != -1);
+
+    // 新连接通知
+    init_wakeup(id, close_log);
+    epoll_event event;
+    event.data.fd = m_wakeupfd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakeupfd, &event);
+
+    // 子反应堆收不到SIGALRM管道消息，用timerfd按m_timeslot周期驱动定时器
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerfd != -1);
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = m_timeslot;
+    its.it_interval.tv_sec = m_timeslot;
+    timerfd_settime(m_timerfd, 0, &its, nullptr);
+    event.data.fd = m_timerfd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_timerfd, &event);
+
+    // 固定模式下线程池的完成通知
+    if(m_conn_pinned){
+        event.data.fd = m_done.get_fd();
+        event.events = EPOLLIN;
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_done.get_fd(), &event);
+    }
+}
+
+void sub_reactor::set_listenfd(int listenfd, int listen_trig_mode){
+    m_listenfd = listenfd;
+    m_listen_trig_mode = listen_trig_mode;
+    Utils utils;
+    utils.addfd(m_epollfd, m_listenfd, false, m_listen_trig_mode);
+}
+
+// 接管主反应堆投递的新连接
+void sub_reactor::deal_new_conn(){
+    vector<pair<int, sockaddr_in>> pending;
+    take_pending(pending);
+
+    for(size_t i = 0; i < pending.size(); ++i){
+        add_conn(pending[i].first, pending[i].second);
+    }
+}
+
+// 在本反应堆的监听套接字上接受新连接，不经过主反应堆
+void sub_reactor::deal_accept(){
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+    while(true){
+        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+        if(connfd < 0){
+            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                LOG_ERROR("sub reactor %d accept error:%d", m_id, errno);
+            }
+            break;
+        }
+        if(http_conn::m_user_count >= MAX_FD){
+            Utils::show_error(connfd, "Internal server busy");
+            LOG_ERROR("%s", "Internal server busy");
+            break;
+        }
+        add_conn(connfd, client_address);
+        // LT模式每次只接受一个，其余留给下一轮epoll_wait
+        if(m_listen_trig_mode == 0)
+            break;
+    }
+}
+
+// 初始化客户并在本反应堆的定时器链表上挂定时器
+void sub_reactor::add_conn(int connfd, const sockaddr_in &client_address){
+    users[connfd].init(connfd, client_address, m_root, m_conn_trig_mode, m_close_log, m_epollfd, m_conn_pinned);
+
+    users_timer[connfd].address = client_address;
+    users_timer[connfd].sockfd = connfd;
+    users_timer[connfd].epollfd = m_epollfd;
+    util_timer *timer = new util_timer;
+    timer->user_data = &users_timer[connfd];
+    timer->cb_func = cb_func;
+    time_t cur = time(NULL);
+    timer->expire = cur + conn_timeouts[PHASE_HEADER];
+    users_timer[connfd].timer = timer;
+    m_timer_lst.add_timer(timer);
+}
+
+// 按连接当前阶段更新超时
+void sub_reactor::adjust_timer(util_timer *timer){
+    m_timer_lst.refresh(timer, users[timer->user_data->sockfd].timeout_phase());
+}
+
+// 释放连接，删除计时器；与主反应堆相同，只在连接未投递给工作线程时调用
+void sub_reactor::deal_timer(util_timer *timer, int sockfd){
+    if(!timer)
+        return;
+    users_timer[sockfd].timer = nullptr;
+    m_timer_lst.del_timer(timer);
+    users[sockfd].close_conn();
+
+    LOG_INFO("sub reactor %d close fd %d", m_id, sockfd);
+}
+
+// 超时释放连接，工作线程仍在处理时推迟一个时钟周期
+void sub_reactor::deal_timeout(client_data *user_data){
+    int sockfd = user_data->sockfd;
+    if(users[sockfd].in_worker()){
+        user_data->timer->expire = time(NULL) + m_timeslot;
+        return;
+    }
+    user_data->timer = nullptr;
+    users[sockfd].close_conn();
+
+    LOG_INFO("sub reactor %d timeout close fd %d", m_id, sockfd);
+}
+
+void sub_reactor::cb_func(client_data *user_data){
+    assert(user_data);
+    t_reactor->deal_timeout(user_data);
+}
+
+// 子反应堆线程内完成读，业务逻辑交给线程池
+void sub_reactor::dealwithread(int sockfd){
+    util_timer *timer = users_timer[sockfd].timer;
+
+    if(users[sockfd].read_once()){
+        if(timer){
+            adjust_timer(timer);
+        }
+        m_pool->append_p(users + sockfd);
+    }
+    else{
+        deal_timer(timer, sockfd);
+    }
+}
+
+// 子反应堆线程内完成写
+void sub_reactor::dealwithwrite(int sockfd){
+    util_timer *timer = users_timer[sockfd].timer;
+
+    if(users[sockfd].write()){
+        if(timer){
+            adjust_timer(timer);
+        }
+        // 读缓冲中还有流水线请求，交给线程池继续处理
+        if(users[sockfd].has_buffered())
+            m_pool->append_p(users + sockfd);
+    }
+    else{
+        deal_timer(timer, sockfd);
+    }
+}
+
+// 固定模式：读、处理、写都在本线程完成，不经线程池，也不重新注册事件
+void sub_reactor::dealwithpinned(int sockfd, uint32_t events){
+    util_timer *timer = users_timer[sockfd].timer;
+    if(!timer)
+        return;
+    // 请求在线程池中处理，完成后重新读写
+    if(users[sockfd].in_worker())
+        return;
+
+    bool ok = true;
+    if(events & EPOLLOUT)
+        ok = users[sockfd].write();
+    if(ok && (events & EPOLLIN))
+        ok = users[sockfd].read_once();
+    // 发完一批响应后继续处理缓冲区中的流水线请求
+    if(ok)
+        ok = users[sockfd].process_inline();
+
+    if(ok){
+        adjust_timer(timer);
+        if(users[sockfd].wants_worker())
+            offload(sockfd);
+    }
+    else
+        deal_timer(timer, sockfd);
+}
+
+void sub_reactor::offload(int sockfd){
+    http_conn *conn = users + sockfd;
+    // improv在完成项被取走前保持为1，期间不处理该连接的事件，超时也推迟释放
+    conn->improv.store(1, std::memory_order_relaxed);
+    bool ok = m_pool->submit([this, conn]{
+        conn->m_worker.store(task_pool::current_worker(), std::memory_order_relaxed);
+        conn->timer_flag.store(conn->process_buffer() < 0 ? 1 : 0, std::memory_order_relaxed);
+        m_done.push(conn);
+    }, conn->m_worker.load(std::memory_order_relaxed));
+    if(!ok){
+        LOG_ERROR("sub reactor %d task queue full", m_id);
+        conn->improv.store(0, std::memory_order_relaxed);
+        deal_timer(users_timer[sockfd].timer, sockfd);
+    }
+}
+
+// 发送线程池生成的响应，读入期间到达的数据并继续处理
+void sub_reactor::deal_done(){
+    http_conn *conn = m_done.pop_all();
+    while(conn){
+        http_conn *next = conn->m_done_next;
+        int sockfd = conn - users;
+        conn->improv.store(0, std::memory_order_relaxed);
+        if(conn->timer_flag.exchange(0, std::memory_order_relaxed) == 1)
+            deal_timer(users_timer[sockfd].timer, sockfd);
+        else
+            dealwithpinned(sockfd, EPOLLIN | EPOLLOUT);
+        conn = next;
+    }
+}
+
+void sub_reactor::run(){
+    // 主循环占用第0个循环cpu；绑核后再分配事件列表，放在本线程所在的NUMA节点上
+    char name[16];
+    snprintf(name, sizeof(name), "loop-%d", m_id);
+    place_thread(name, cpu_affinity::get_instance()->loop_cpu(m_id + 1));
+    events = (epoll_event *)numa_alloc(sizeof(epoll_event) * MAX_EVENT_NUMBER, thread_node());
+    if(!events){
+        LOG_ERROR("sub reactor %d event list alloc failure", m_id);
+        return;
+    }
+    t_reactor = this;
+    while(!m_stop){
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        if(number < 0 && errno != EINTR){
+            LOG_ERROR("sub reactor %d epoll failure", m_id);
+            break;
+        }
+        for(int i = 0; i < number; i++){
+            int sockfd = events[i].data.fd;
+            // 本反应堆监听套接字上的新连接
+            if(sockfd == m_listenfd){
+                deal_accept();
+            }
+            // 主反应堆投递了新连接
+            else if(sockfd == m_wakeupfd){
+                deal_new_conn();
+            }
+            // 固定模式下线程池处理完毕
+            else if(sockfd == m_done.get_fd()){
+                deal_done();
+            }
+            // 定时器到期
+            else if(sockfd == m_timerfd){
+                uint64_t expirations;
+                while(read(m_timerfd, &expirations, sizeof(expirations)) > 0);
+                m_timer_lst.tick();
+            }
+            // 对端关闭
+            else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+                // 固定模式下请求仍在线程池中，完成后读到对端关闭再释放
+                if(m_conn_pinned && users[sockfd].in_worker())
+                    continue;
+                deal_timer(users_timer[sockfd].timer, sockfd);
+            }
+            else if(m_conn_pinned){
+                dealwithpinned(sockfd, events[i].events);
+            }
+            else if(events[i].events & EPOLLIN){
+                dealwithread(sockfd);
+            }
+            else if(events[i].events & EPOLLOUT){
+                dealwithwrite(sockfd);
+            }
+        }
+    }
+}
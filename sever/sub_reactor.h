@@ -0,0 +1,66 @@
+#ifndef SUB_REACTOR_H
+#define SUB_REACTOR_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <string>
+
+#include "event_loop.h"
+#include "../threadpool/thradpool.h"
+#include "../http/http_conn.h"
+#include "../timer/lst_timer.h"
+
+using namespace std;
+
+// 子反应堆：epoll引擎的子事件循环，独占一个epoll句柄、一个定时器链表和一个线程
+// 主反应堆只负责accept，将连接分发给子反应堆，之后该连接的读写事件与超时都只在该子反应堆线程中处理
+// users/users_timer仍按fd下标共享，但fd在进程内唯一，每个子反应堆只访问自己持有的那部分下标
+class sub_reactor : public event_loop{
+public:
+    sub_reactor();
+    ~sub_reactor();
+
+    void init(int id, http_conn *users, client_data *users_timer, threadpool<http_conn> *pool,
+              const char *root, int conn_trig_mode, int close_log, int timeslot, int conn_pinned = 0);
+    void set_listenfd(int listenfd, int listen_trig_mode);
+
+private:
+    void run();
+
+    void deal_new_conn();
+    void deal_accept();
+    void add_conn(int connfd, const sockaddr_in &client_address);
+    void adjust_timer(util_timer *timer);
+    void deal_timer(util_timer *timer, int sockfd);
+    void deal_timeout(client_data *user_data);
+    void dealwithread(int sockfd);
+    void dealwithwrite(int sockfd);
+    void dealwithpinned(int sockfd, uint32_t events);
+    // 固定模式下带处理函数的请求交给线程池，处理完经完成队列交回本线程发送
+    void offload(int sockfd);
+    void deal_done();
+
+    // 定时器回调，在本反应堆线程的tick中执行
+    static void cb_func(client_data *user_data);
+
+private:
+    http_conn *users;                   // 客户请求结构，与主反应堆共享
+    client_data *users_timer;           // 客户数据结构，与主反应堆共享
+    threadpool<http_conn> *m_pool;      // 线程池
+
+    const char *m_root;     // 资源路径
+    int m_conn_trig_mode;   // 连接触发模式，0 LT，1 ET
+    int m_conn_pinned;      // 连接固定在本线程处理，持久ET注册
+    int m_timeslot;         // 最小超时单位
+
+    int m_listenfd;             // 本反应堆的监听套接字，-1表示由主反应堆accept
+    int m_listen_trig_mode;     // 监听触发模式
+    int m_epollfd;              // 本反应堆的epoll句柄
+    int m_timerfd;              // timerfd，周期性驱动定时器链表
+    epoll_event *events;        // 事件列表
+    sort_timer_lst m_timer_lst; // 本反应堆的定时器链表
+    completion_queue<http_conn> m_done;     // 固定模式下工作线程处理完的连接
+};
+
+#endif
@@ -0,0 +1,423 @@
+#include <sys/timerfd.h>
+#include <poll.h>
+
+#include "websever.h"
+#include "uring_loop.h"
+#include "../threadpool/thread_affinity.h"
+
+// 定时器回调没有this指针，每个环线程记录自己的循环
+static thread_local uring_loop *t_loop = nullptr;
+
+uring_loop::uring_loop(){
+    m_bufs = nullptr;
+    m_conns = nullptr;
+    m_accept_paused = false;
+    m_listenfd = -1;
+    m_timerfd = -1;
+}
+
+uring_loop::~uring_loop(){
+    stop();
+    if(m_timerfd != -1)
+        close(m_timerfd);
+    if(m_listenfd != -1)
+        close(m_listenfd);
+    numa_free(m_bufs, (size_t)BUF_COUNT * BUF_SIZE);
+    delete[] m_conns;
+}
+
+bool uring_loop::init(int id, http_conn *users, client_data *users_timer, threadpool<http_conn> *pool,
+                      const char *root, int close_log, int timeslot){
+    this->users = users;
+    this->users_timer = users_timer;
+    m_pool = pool;
+    m_root = root;
+    m_timeslot = timeslot;
+
+    if(!m_ring.init(4096))
+        return false;
+    init_wakeup(id, close_log);
+    m_conns = new conn_state[MAX_FD];
+    memset(m_conns, 0, sizeof(conn_state) * MAX_FD);
+
+    // 与子反应堆相同，用timerfd按m_timeslot周期驱动定时器
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerfd != -1);
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = m_timeslot;
+    its.it_interval.tv_sec = m_timeslot;
+    timerfd_settime(m_timerfd, 0, &its, nullptr);
+    return true;
+}
+
+void uring_loop::set_listenfd(int listenfd, int listen_trig_mode){
+    // 多shot accept一次提交持续接收，不区分触发模式
+    (void)listen_trig_mode;
+    m_listenfd = listenfd;
+}
+
+bool uring_loop::is_stale(uint64_t user_data){
+    int fd = (int)(user_data & 0xffffffff);
+    uint32_t gen = (uint32_t)(user_data >> 32) & 0xffffff;
+    return gen != (m_conns[fd].gen & 0xffffff);
+}
+
+void uring_loop::submit_accept(){
+    struct io_uring_sqe *sqe = m_ring.get_sqe();
+    if(!sqe){
+        park(OP_ACCEPT, m_listenfd);
+        return;
+    }
+    uring::prep_accept_multishot(sqe, m_listenfd, encode(OP_ACCEPT, 0, m_listenfd));
+}
+
+void uring_loop::submit_recv(int fd){
+    struct io_uring_sqe *sqe = m_ring.get_sqe();
+    if(!sqe){
+        LOG_ERROR("ring %d submission queue full, close fd %d", m_id, fd);
+        close_conn(fd);
+        return;
+    }
+    uring::prep_recv_select(sqe, fd, BUF_SIZE, BUF_GROUP, encode(OP_RECV, m_conns[fd].gen, fd));
+}
+
+// 发送期间向量与正文归连接所有，完成事件回来之前不能释放
+void uring_loop::submit_write(int fd){
+    struct io_uring_sqe *sqe = m_ring.get_sqe();
+    if(!sqe){
+        LOG_ERROR("ring %d submission queue full, close fd %d", m_id, fd);
+        close_conn(fd);
+        return;
+    }
+    int count = 0;
+    struct iovec *iv = users[fd].get_iv(count);
+    m_conns[fd].busy = true;
+    uring::prep_writev(sqe, fd, iv, count, encode(OP_WRITE, m_conns[fd].gen, fd));
+}
+
+void uring_loop::submit_poll(int op, int fd){
+    struct io_uring_sqe *sqe = m_ring.get_sqe();
+    if(!sqe){
+        park(op, fd);
+        return;
+    }
+    uring::prep_poll(sqe, fd, POLLIN, encode(op, 0, fd));
+}
+
+// 数据已拷入连接的读缓冲，归还缓冲区
+void uring_loop::provide_buffer(int bid, int count){
+    struct io_uring_sqe *sqe = m_ring.get_sqe();
+    if(!sqe){
+        park(OP_PROVIDE, bid, count);
+        return;
+    }
+    uring::prep_provide_buffers(sqe, m_bufs + bid * BUF_SIZE, BUF_SIZE, count, BUF_GROUP, bid, encode(OP_PROVIDE, 0, 0));
+    // 成功时不产生完成事件，只在失败时上报
+    sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+}
+
+void uring_loop::park(int op, int arg, int count){
+    parked_sqe p = {op, arg, count};
+    m_parked.push_back(p);
+}
+
+// 完成事件已收割，CQ腾出空间后重新提交；仍取不到SQE的再次暂存
+void uring_loop::resubmit_parked(){
+    vector<parked_sqe> parked;
+    parked.swap(m_parked);
+    for(size_t i = 0; i < parked.size(); ++i){
+        switch(parked[i].op){
+            case OP_ACCEPT: submit_accept(); break;
+            case OP_PROVIDE: provide_buffer(parked[i].arg, parked[i].count); break;
+            default: submit_poll(parked[i].op, parked[i].arg); break;
+        }
+    }
+}
+
+// 初始化客户并在本环的定时器链表上挂定时器
+void uring_loop::add_conn(int connfd, const sockaddr_in &client_address){
+    m_conns[connfd].busy = false;
+    m_conns[connfd].closing = false;
+    users[connfd].init(connfd, client_address, m_root, 0, m_close_log, http_conn::NO_EPOLL);
+
+    users_timer[connfd].address = client_address;
+    users_timer[connfd].sockfd = connfd;
+    users_timer[connfd].epollfd = -1;
+    util_timer *timer = new util_timer;
+    timer->user_data = &users_timer[connfd];
+    timer->cb_func = cb_func;
+    time_t cur = time(NULL);
+    timer->expire = cur + conn_timeouts[PHASE_HEADER];
+    users_timer[connfd].timer = timer;
+    m_timer_lst.add_timer(timer);
+
+    submit_recv(connfd);
+}
+
+void uring_loop::close_conn(int fd){
+    util_timer *timer = users_timer[fd].timer;
+    if(timer){
+        users_timer[fd].timer = nullptr;
+        m_timer_lst.del_timer(timer);
+    }
+    release_conn(fd);
+}
+
+void uring_loop::release_conn(int fd){
+    // 挂起的recv在fd关闭后仍持有socket，shutdown使其立即完成，对端也能及时收到FIN
+    shutdown(fd, SHUT_RDWR);
+    if(m_conns[fd].busy){
+        m_conns[fd].closing = true;
+        return;
+    }
+    m_conns[fd].closing = false;
+    // 之后到达的旧完成事件都按过期处理，fd被新连接复用也不受影响
+    m_conns[fd].gen++;
+    users[fd].close_conn();
+    LOG_INFO("ring %d close fd %d", m_id, fd);
+}
+
+void uring_loop::cb_func(client_data *user_data){
+    assert(user_data);
+    // 定时器随后由链表释放，置空防止再次使用
+    user_data->timer = nullptr;
+    t_loop->release_conn(user_data->sockfd);
+}
+
+void uring_loop::deal_accept(struct io_uring_cqe *cqe){
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    int connfd = cqe->res;
+    if(connfd < 0){
+        LOG_ERROR("ring %d accept error:%d", m_id, -connfd);
+        if(more)
+            return;
+        // 多shot accept出错后被内核终止：连接在握手后被放弃等瞬时错误立即重新提交；
+        // fd或内存耗尽时重新提交会立即再次失败，等下一个时钟周期；其余错误说明监听套接字不可用，不再提交
+        switch(-connfd){
+            case ECONNABORTED:
+            case EINTR:
+            case EAGAIN:
+            case EPROTO:
+            case EPERM:
+                submit_accept();
+                break;
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                m_accept_paused = true;
+                break;
+            default:
+                LOG_ERROR("ring %d stop accepting", m_id);
+                break;
+        }
+        return;
+    }
+    // 多shot accept被内核终止（如CQ溢出），需要重新提交
+    if(!more)
+        submit_accept();
+    if(http_conn::m_user_count >= MAX_FD){
+        Utils::show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+    struct sockaddr_in client_address;
+    socklen_t len = sizeof(client_address);
+    getpeername(connfd, (struct sockaddr *)&client_address, &len);
+    add_conn(connfd, client_address);
+}
+
+// 接管主反应堆投递的新连接
+void uring_loop::deal_new_conn(){
+    vector<pair<int, sockaddr_in>> pending;
+    take_pending(pending);
+
+    for(size_t i = 0; i < pending.size(); ++i){
+        add_conn(pending[i].first, pending[i].second);
+    }
+}
+
+void uring_loop::deal_recv(struct io_uring_cqe *cqe){
+    int fd = (int)(cqe->user_data & 0xffffffff);
+    int bid = -1;
+    if(cqe->flags & IORING_CQE_F_BUFFER){
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    }
+    if(is_stale(cqe->user_data)){
+        if(bid >= 0)
+            provide_buffer(bid);
+        return;
+    }
+    // 缓冲区组暂时耗尽，等归还后再提交
+    if(cqe->res == -ENOBUFS){
+        m_nobuf.push_back(cqe->user_data);
+        return;
+    }
+    if(cqe->res <= 0){
+        if(bid >= 0)
+            provide_buffer(bid);
+        close_conn(fd);
+        return;
+    }
+
+    bool ok = users[fd].read_from(m_bufs + bid * BUF_SIZE, cqe->res);
+    provide_buffer(bid);
+    if(!ok){
+        close_conn(fd);
+        return;
+    }
+    m_timer_lst.refresh(users_timer[fd].timer, users[fd].timeout_phase());
+    process(fd);
+}
+
+// 交给线程池，完成前环线程不再访问该连接
+void uring_loop::process(int fd){
+    http_conn *conn = users + fd;
+    m_conns[fd].busy = true;
+    if(!m_pool->submit([this, conn]{ work(conn); }, conn->m_worker.load(std::memory_order_relaxed))){
+        LOG_ERROR("ring %d task queue full", m_id);
+        m_conns[fd].busy = false;
+        close_conn(fd);
+    }
+}
+
+void uring_loop::work(http_conn *conn){
+    // 记录处理线程，该连接的下一个请求优先投递回来
+    conn->m_worker.store(task_pool::current_worker(), std::memory_order_relaxed);
+    int ret = conn->process_buffer();
+    // 与reactor模式相同，timer_flag表示需要关闭连接；m_state为1表示响应已就绪，0表示请求不完整
+    conn->timer_flag.store(ret < 0 ? 1 : 0, std::memory_order_relaxed);
+    conn->m_state = ret > 0 ? 1 : 0;
+    // 入队的release保证以上写入对环线程可见
+    m_done.push(conn);
+}
+
+// 根据工作线程的处理结果提交写或继续接收
+void uring_loop::deal_done(){
+    http_conn *conn = m_done.pop_all();
+    while(conn){
+        http_conn *next = conn->m_done_next;
+        int fd = conn - users;
+        m_conns[fd].busy = false;
+        if(m_conns[fd].closing || conn->timer_flag.exchange(0, std::memory_order_relaxed) == 1){
+            close_conn(fd);
+        }
+        else{
+            m_timer_lst.refresh(users_timer[fd].timer, conn->timeout_phase());
+            if(conn->m_state == 1)
+                submit_write(fd);
+            else
+                submit_recv(fd);
+        }
+        conn = next;
+    }
+}
+
+void uring_loop::deal_write(struct io_uring_cqe *cqe){
+    int fd = (int)(cqe->user_data & 0xffffffff);
+    if(is_stale(cqe->user_data))
+        return;
+    m_conns[fd].busy = false;
+    if(m_conns[fd].closing || cqe->res < 0){
+        close_conn(fd);
+        return;
+    }
+    // 未发送完，继续提交剩余部分，有进展即延长发送超时
+    if(!users[fd].on_sent(cqe->res)){
+        m_timer_lst.refresh(users_timer[fd].timer, PHASE_WRITE);
+        submit_write(fd);
+        return;
+    }
+    if(!users[fd].finish_response())
+        close_conn(fd);
+    // 读缓冲中还有流水线请求
+    else if(users[fd].has_buffered())
+        process(fd);
+    else{
+        m_timer_lst.refresh(users_timer[fd].timer, users[fd].timeout_phase());
+        submit_recv(fd);
+    }
+}
+
+void uring_loop::run(){
+    // 主循环占用第0个循环cpu；绑核后再分配provided buffer，放在本线程所在的NUMA节点上
+    char name[16];
+    snprintf(name, sizeof(name), "ring-%d", m_id);
+    place_thread(name, cpu_affinity::get_instance()->loop_cpu(m_id + 1));
+    m_bufs = (char *)numa_alloc((size_t)BUF_COUNT * BUF_SIZE, thread_node());
+    if(!m_bufs){
+        LOG_ERROR("ring %d buffer alloc failure", m_id);
+        return;
+    }
+    t_loop = this;
+
+    // 一次提供全部缓冲区
+    provide_buffer(0, BUF_COUNT);
+    if(m_listenfd != -1)
+        submit_accept();
+    submit_poll(OP_WAKEUP, m_wakeupfd);
+    submit_poll(OP_TIMER, m_timerfd);
+    submit_poll(OP_DONE, m_done.get_fd());
+
+    while(!m_stop){
+        // 提交本轮积累的所有请求，并等待至少一个完成事件
+        // CQ溢出时返回EBUSY，照常收割完成事件腾出空间
+        int ret = m_ring.submit_and_wait(1);
+        if(ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN){
+            LOG_ERROR("ring %d io_uring failure", m_id);
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while((cqe = m_ring.peek_cqe()) != nullptr){
+            int op = (int)(cqe->user_data >> 56);
+            switch(op){
+                case OP_ACCEPT: deal_accept(cqe); break;
+                case OP_RECV: deal_recv(cqe); break;
+                case OP_WRITE: deal_write(cqe); break;
+                // 主反应堆投递了新连接，或通知退出
+                case OP_WAKEUP:{
+                    deal_new_conn();
+                    submit_poll(OP_WAKEUP, m_wakeupfd);
+                    break;
+                }
+                // 定时器到期，fd耗尽时暂停的accept在此恢复
+                case OP_TIMER:{
+                    uint64_t expirations;
+                    while(read(m_timerfd, &expirations, sizeof(expirations)) > 0);
+                    m_timer_lst.tick();
+                    if(m_accept_paused){
+                        m_accept_paused = false;
+                        submit_accept();
+                    }
+                    submit_poll(OP_TIMER, m_timerfd);
+                    break;
+                }
+                // 工作线程处理完毕
+                case OP_DONE:{
+                    deal_done();
+                    submit_poll(OP_DONE, m_done.get_fd());
+                    break;
+                }
+                case OP_PROVIDE:{
+                    if(cqe->res < 0)
+                        LOG_ERROR("ring %d provide buffers error:%d", m_id, -cqe->res);
+                    break;
+                }
+            }
+            m_ring.cqe_seen();
+        }
+
+        if(!m_parked.empty())
+            resubmit_parked();
+        // 重新提交因缓冲区耗尽失败的接收，本轮归还缓冲区的请求排在它们之前，提交时先执行
+        if(!m_nobuf.empty()){
+            for(size_t i = 0; i < m_nobuf.size(); ++i){
+                if(!is_stale(m_nobuf[i]))
+                    submit_recv((int)(m_nobuf[i] & 0xffffffff));
+            }
+            m_nobuf.clear();
+        }
+    }
+}
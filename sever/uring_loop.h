@@ -0,0 +1,113 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+#include "../iouring/uring.h"
+#include "../http/http_conn.h"
+#include "../timer/lst_timer.h"
+#include "../threadpool/thradpool.h"
+
+using namespace std;
+
+// io_uring引擎的子事件循环，替代epoll_wait + recv + writev + epoll_ctl(MOD)
+// 多shot accept持续接收新连接，recv从provided buffer组取缓冲区，唤醒、定时与工作线程的完成通知也以poll请求挂在环上，
+// 每轮循环中产生的所有请求在一次io_uring_enter中批量提交并同时收割完成事件
+// 环线程只做收发，解析与生成响应交给线程池，处理函数可以阻塞在数据库上而不拖住其他连接
+// 文件正文取自映射内存随报头一起writev发出，零拷贝sendfile模式在本引擎下不启用
+class uring_loop : public event_loop{
+public:
+    uring_loop();
+    ~uring_loop();
+
+    // 创建环，失败返回false，调用方改用epoll子反应堆；内核特性由uring::probe事先检查
+    bool init(int id, http_conn *users, client_data *users_timer, threadpool<http_conn> *pool,
+              const char *root, int close_log, int timeslot);
+    void set_listenfd(int listenfd, int listen_trig_mode);
+
+private:
+    void run();
+
+    // user_data编码：高8位操作类型，中间24位连接代数，低32位fd
+    enum OP{
+        OP_ACCEPT = 1, OP_RECV, OP_WRITE, OP_WAKEUP, OP_TIMER, OP_DONE, OP_PROVIDE
+    };
+    static uint64_t encode(int op, uint32_t gen, int fd){
+        return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+    }
+    // 完成事件是否属于已关闭的连接，连接关闭时代数加一
+    bool is_stale(uint64_t user_data);
+
+    // SQ满且内核暂不接收（如CQ溢出时io_uring_enter返回EBUSY）时取不到SQE：
+    // accept、poll和归还缓冲区暂存到m_parked，收割完本轮完成事件后重新提交；recv和writev直接关闭连接
+    void submit_accept();
+    void submit_recv(int fd);
+    void submit_write(int fd);
+    // 等待eventfd或timerfd可读
+    void submit_poll(int op, int fd);
+    void provide_buffer(int bid, int count = 1);
+    void park(int op, int arg, int count = 1);
+    void resubmit_parked();
+
+    void deal_accept(struct io_uring_cqe *cqe);
+    void deal_recv(struct io_uring_cqe *cqe);
+    void deal_write(struct io_uring_cqe *cqe);
+    void deal_new_conn();
+    void deal_done();
+
+    // 交给线程池解析并生成响应
+    void process(int fd);
+    // 工作线程中执行，结果经完成队列交回环线程
+    void work(http_conn *conn);
+    void add_conn(int connfd, const sockaddr_in &client_address);
+    // 删除定时器并关闭连接
+    void close_conn(int fd);
+    // 经http_conn::close_conn释放缓冲、映射并减少连接数；
+    // 连接在工作线程中或writev未完成时先shutdown，等完成事件回来再释放
+    void release_conn(int fd);
+
+    // 定时器回调，在环线程的tick中执行
+    static void cb_func(client_data *user_data);
+
+private:
+    static const int BUF_GROUP = 0;     // provided buffer组号
+    static const int BUF_COUNT = 1024;  // 缓冲区个数
+    static const int BUF_SIZE = 2048;   // 单个缓冲区大小
+
+    // 连接在本环上的状态，按fd下标
+    struct conn_state{
+        uint32_t gen;       // 连接代数，过滤已关闭连接的旧完成事件
+        bool busy;          // 在工作线程中处理，或有未完成的writev
+        bool closing;       // 等busy结束后关闭
+    };
+
+    // 未取到SQE、等待重新提交的请求
+    struct parked_sqe{
+        int op;
+        int arg;        // poll为fd，归还缓冲区为起始编号
+        int count;      // 归还缓冲区的个数
+    };
+
+    uring m_ring;
+    char *m_bufs;               // provided buffer连续内存
+    conn_state *m_conns;
+    vector<uint64_t> m_nobuf;   // 因缓冲区耗尽未能接收、待重新提交的接收，按user_data记录
+    vector<parked_sqe> m_parked;    // 因SQ满未能提交的accept、poll和归还缓冲区
+    bool m_accept_paused;       // fd耗尽等暂时性错误后停止accept，下一个时钟周期再提交
+    completion_queue<http_conn> m_done;     // 工作线程处理完的连接
+
+    http_conn *users;
+    client_data *users_timer;
+    threadpool<http_conn> *m_pool;
+    int m_listenfd;             // 本环的监听套接字，-1表示由主反应堆accept
+    int m_timerfd;              // timerfd，周期性驱动定时器链表
+    sort_timer_lst m_timer_lst; // 本环的定时器链表
+
+    const char *m_root;
+    int m_timeslot;
+};
+
+#endif
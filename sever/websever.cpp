@@ -1,8 +1,12 @@
-#include "webserver.h"
+#include "websever.h"
+
+// 定时器回调没有this指针，记录服务器实例
+static WebServer *s_server = nullptr;
 
 WebServer::WebServer(string user, string password, string database_name, const char *root,
                      int port, int close_log, int async_log, int sql_num,
-                     int thread_num, int actor_model, int trig_mode, int opt_linger){
+                     int thread_num, int actor_model, int trig_mode, int opt_linger,
+                     int sub_reactor_num, int io_backend, int conn_pinned){
     m_user = user;
     m_passWord = password;
     m_databaseName = database_name;
@@ -16,23 +20,58 @@ WebServer::WebServer(string user, string password, string database_name, const c
     m_listen_trig_mode = trig_mode & 2;
     m_conn_trig_mode = trig_mode & 1;
     m_opt_linger = opt_linger;
+    m_sub_reactor_num = sub_reactor_num;
+    m_io_backend = io_backend;
+    m_conn_pinned = conn_pinned;
+    s_server = this;
+    m_sub_reactors = nullptr;
+    m_next_reactor = 0;
+    m_completion = nullptr;
+    m_backlog = 5;
+    m_reuseport = 0;
+    m_defer_accept = 0;
+    m_fastopen = 0;
+    m_cache_mb = 0;
+    m_cache_entries = 0;
+    m_resp_cache_mb = 0;
+    m_resp_file_kb = 0;
+    m_compress_mb = 0;
+    m_compress_min = 0;
+    m_compress_max_kb = 0;
+    m_body_max_mb = 64;
+    m_spill_dir = "/tmp";
+    m_timeslot = TIMESLOT;
+    m_queue_mode = QUEUE_LOCKED;
+    m_thread_max = 0;
+    m_target_wait_us = 5000;
+    m_idle_ms = 10000;
+    m_last_stats = pool_stats();
+    m_pool = nullptr;
     
     users = new http_conn[MAX_FD];
     users_timer = new client_data[MAX_FD];
+    // 内置路由先注册，之后注册的同名路由将其覆盖
+    http_conn::init_routes();
     log_write();
     sql_pool();
-    thread_pool();
 }
 
 WebServer::~WebServer(){
+    // 先停掉子反应堆线程，再释放其访问的连接数组
+    if(m_sub_reactors){
+        for(int i = 0; i < m_sub_reactor_num; ++i)
+            delete m_sub_reactors[i];
+        delete[] m_sub_reactors;
+    }
     close(m_epollfd);
-    close(m_listenfd);
+    if(m_listenfd != -1)
+        close(m_listenfd);
     close(m_pipefd[1]);
     close(m_pipefd[0]);
     delete[] users;
     delete[] users_timer;
     delete m_pool;
-    delete m_connPool;
+    delete m_completion;
 }
 
 // 初始化日志
@@ -59,26 +98,121 @@ void WebServer::sql_pool(){
 
 // 初始化线程池
 void WebServer::thread_pool(){
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    // 多反应堆下读写都在子反应堆线程完成，线程池只做业务处理
+    // 固定模式下请求在循环线程内处理，不使用reactor完成队列
+    int actor_model = (m_sub_reactor_num > 0 || m_conn_pinned) ? 0 : m_actormodel;
+    m_pool = new threadpool<http_conn>(actor_model, m_thread_num, 100000, m_queue_mode,
+                                       m_thread_max, m_target_wait_us, m_idle_ms);
+    // reactor模式工作线程通过完成队列通知事件循环，避免事件循环忙等
+    if(actor_model == 1){
+        m_completion = new completion_queue<http_conn>;
+        m_pool->set_completion(m_completion);
+    }
+    // 固定模式下只有处理函数在线程池中执行，完成后交回主循环
+    else if(m_conn_pinned && m_sub_reactor_num <= 0){
+        m_completion = new completion_queue<http_conn>;
+    }
 }
 
-// 监听事件，网络编程基础步骤
-void WebServer::eventListen(){
+// 设置监听选项
+void WebServer::set_listen(int backlog, int reuseport, int defer_accept, int fastopen){
+    m_backlog = backlog > 0 ? backlog : 5;
+    m_reuseport = reuseport;
+    m_defer_accept = defer_accept;
+    m_fastopen = fastopen;
+}
+
+// 设置静态文件发送方式
+void WebServer::set_zero_copy(int zero_copy){
+    http_conn::m_zero_copy = zero_copy;
+}
+
+// 设置静态文件缓存
+void WebServer::set_file_cache(int max_mb, int max_entries){
+    m_cache_mb = max_mb;
+    m_cache_entries = max_entries;
+}
+
+// 设置小文件响应缓存
+void WebServer::set_response_cache(int budget_mb, int max_file_kb){
+    m_resp_cache_mb = budget_mb;
+    m_resp_file_kb = max_file_kb;
+}
+
+void WebServer::set_compression(int precompressed, int budget_mb, int min_bytes, int max_kb){
+    http_conn::m_precompressed = precompressed;
+    m_compress_mb = budget_mb;
+    m_compress_min = min_bytes;
+    m_compress_max_kb = max_kb;
+}
+
+void WebServer::set_header_rule(const char *prefix, const char *content_type, const char *cache_control){
+    header_rules::get_instance()->add(prefix, content_type ? content_type : "", cache_control ? cache_control : "");
+}
+
+void WebServer::set_body_limit(int max_mb, const char *spill_dir){
+    m_body_max_mb = max_mb;
+    m_spill_dir = spill_dir;
+}
+
+void WebServer::set_thread_queue(int queue_mode){
+    m_queue_mode = queue_mode;
+}
+
+void WebServer::set_thread_limits(int max_threads, int target_wait_us, int idle_ms){
+    m_thread_max = max_threads;
+    m_target_wait_us = target_wait_us > 0 ? target_wait_us : 5000;
+    m_idle_ms = idle_ms > 0 ? idle_ms : 10000;
+}
+
+void WebServer::set_cpu_affinity(const char *loop_cpus, const char *worker_cpus){
+    cpu_affinity::get_instance()->init(loop_cpus, worker_cpus);
+}
+
+void WebServer::set_timeouts(int header, int body, int idle, int write, int max_requests){
+    conn_timeouts[PHASE_HEADER] = header;
+    conn_timeouts[PHASE_BODY] = body;
+    conn_timeouts[PHASE_IDLE] = idle;
+    conn_timeouts[PHASE_WRITE] = write;
+    http_conn::m_max_requests = max_requests;
+    // 检查周期决定超时精度，最短的超时至少检查一次
+    m_timeslot = TIMESLOT;
+    for(int i = 0; i < PHASE_NUM; ++i){
+        if(conn_timeouts[i] < m_timeslot)
+            m_timeslot = conn_timeouts[i] > 1 ? conn_timeouts[i] : 1;
+    }
+}
+
+// 创建监听套接字，SO_REUSEPORT模式下每次调用得到一个绑定同一端口的独立监听队列
+int WebServer::create_listenfd(){
     // ipv4，面向连接
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    assert(listenfd >= 0);
 
     // 优雅关闭连接
     // 缺省为close()继续发送缓冲区残留数据，等待确认然后返回
     // 将修改为close()设置一个超时，发送缓冲区残留数据，全部确认则正常关闭，否则发送RST、丢弃数据并跳过time_wait直接关闭
     if(m_opt_linger){
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     // 重用端口
     int flag = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    // 多个套接字绑定同一端口，由内核在各监听队列间分散新连接
+    if(m_reuseport){
+        int ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        assert(ret >= 0);
+    }
+    // 三次握手完成后等到客户数据到达才放入全连接队列，空握手不唤醒用户态
+    if(m_defer_accept > 0){
+        setsockopt(listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &m_defer_accept, sizeof(m_defer_accept));
+    }
+    // 允许SYN携带数据，省去一个RTT
+    if(m_fastopen > 0){
+        setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN, &m_fastopen, sizeof(m_fastopen));
+    }
 
     struct sockaddr_in address;
     bzero(&address, sizeof(address));
@@ -89,27 +223,54 @@ void WebServer::eventListen(){
 
     // 绑定ip和端口
     int ret = 0;
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+    ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
     // 监听
-    ret = listen(m_listenfd, 5);
+    ret = listen(listenfd, m_backlog);
     assert(ret >= 0);
+    return listenfd;
+}
+
+// 监听事件，网络编程基础步骤
+void WebServer::eventListen(){
+    // io_uring引擎的环总是运行在子反应堆线程上，请求交给线程池处理；未配置子反应堆时使用一个环，由它多shot accept
+    bool ring_accept = false;
+    if(m_io_backend == 1){
+        if(!uring::probe()){
+            LOG_WARN("%s", "io_uring lacks multishot accept, CQE skip or a needed opcode, fall back to epoll");
+            m_io_backend = 0;
+        }
+        else if(m_sub_reactor_num == 0){
+            m_sub_reactor_num = 1;
+            ring_accept = true;
+        }
+    }
+    // SO_REUSEPORT多反应堆模式下由各子反应堆自己监听、accept，主循环只处理信号
+    bool sharded = m_sub_reactor_num > 0 && (m_reuseport || ring_accept);
+    m_listenfd = sharded ? -1 : create_listenfd();
+    int ret = 0;
+
+    // 线程池在选项设置完后创建，请求队列实现由set_thread_queue决定
+    thread_pool();
 
     // 参数没有意义
     m_epollfd = epoll_create(5);
     assert(m_epollfd != -1);
 
-    utils.init(TIMESLOT);
+    utils.init(m_timeslot);
     // 注册事件并设置非阻塞
-    utils.addfd(m_epollfd, m_listenfd, false, m_listen_trig_mode);
+    if(m_listenfd != -1)
+        utils.addfd(m_epollfd, m_listenfd, false, m_listen_trig_mode);
     http_conn::m_epollfd = m_epollfd;
 
     // 创建一对套接字，fd[1]写，fd[0]读
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
     assert(ret != -1);
-    utils.setnonblocking(m_pipefd[1]);
+    utils.setnoblocking(m_pipefd[1]);
     // 统一事件源
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    if(m_completion)
+        utils.addfd(m_epollfd, m_completion->get_fd(), false, 0);
 
     // 两次向已关闭的连接发送数据导致SIGPIPE，避免进程退出，捕获SIGPIPE并忽略
     utils.addsig(SIGPIPE, SIG_IGN);
@@ -121,47 +282,129 @@ void WebServer::eventListen(){
     utils.addsig(SIGABRT, utils.sig_handler, false);
 
     // 定时器
-    alarm(TIMESLOT);
+    alarm(m_timeslot);
 
     Utils::u_pipefd = m_pipefd;
     Utils::u_epollfd = m_epollfd;
+
+    // 大消息体的默认上限和溢出目录
+    body_router::get_instance()->init((long long)m_body_max_mb << 20, m_spill_dir.c_str());
+
+    // 在线压缩在独立线程中进行
+    if(m_compress_mb > 0)
+        compress_cache::get_instance()->init((size_t)m_compress_mb << 20, m_compress_min,
+                                             (size_t)m_compress_max_kb << 10, m_close_log);
+
+    // 文件缓存，mmap发送方式需要缓存映射文件内容
+    if(m_cache_entries > 0){
+        bool map_files = !http_conn::m_zero_copy || m_io_backend == 1;
+        if(file_cache::get_instance()->init((size_t)m_cache_mb << 20, m_cache_entries, map_files, m_close_log) &&
+           m_resp_cache_mb > 0){
+            response_cache::get_instance()->init((size_t)m_resp_cache_mb << 20, (size_t)m_resp_file_kb << 10);
+        }
+    }
+
+    // 多反应堆：每个子反应堆一个线程、一条定时器链表，以及一个epoll句柄或一个io_uring环
+    if(m_sub_reactor_num > 0){
+        m_sub_reactors = new event_loop*[m_sub_reactor_num]();
+        for(int i = 0; i < m_sub_reactor_num; ++i){
+            if(m_io_backend == 1){
+                uring_loop *ring = new uring_loop;
+                if(ring->init(i, users, users_timer, m_pool, m_root, m_close_log, m_timeslot)){
+                    m_sub_reactors[i] = ring;
+                }
+                else{
+                    LOG_WARN("io_uring setup failed for loop %d, use epoll", i);
+                    delete ring;
+                }
+            }
+            if(!m_sub_reactors[i]){
+                sub_reactor *reactor = new sub_reactor;
+                reactor->init(i, users, users_timer, m_pool, m_root, m_conn_trig_mode, m_close_log,
+                              m_timeslot, m_conn_pinned);
+                m_sub_reactors[i] = reactor;
+            }
+            if(sharded){
+                m_sub_reactors[i]->set_listenfd(create_listenfd(), m_listen_trig_mode);
+            }
+            if(!m_sub_reactors[i]->start()){
+                throw std::exception();
+            }
+        }
+    }
 }
 
 // 设置客户和定时器
 void WebServer::timer(int connfd, struct sockaddr_in client_address){
     // 初始化客户
-    users[connfd].init(connfd, client_address, m_root, m_conn_trig_mode, m_close_log, m_user, m_passWord, m_databaseName);
+    users[connfd].init(connfd, client_address, m_root, m_conn_trig_mode, m_close_log, -1, m_conn_pinned);
 
     // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
+    users_timer[connfd].epollfd = m_epollfd;
     util_timer *timer = new util_timer;
     timer->user_data = &users_timer[connfd];
     timer->cb_func = cb_func;
     time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    timer->expire = cur + conn_timeouts[PHASE_HEADER];
     users_timer[connfd].timer = timer;
     utils.m_timer_lst.add_timer(timer);
 }
 
-//若有数据传输，则将定时器往后延迟3个单位
+//若有数据传输，按连接当前阶段重新设置超时
 //并对新的定时器在链表上的位置进行调整
 void WebServer::adjust_timer(util_timer *timer){
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.adjust_timer(timer);
+    utils.m_timer_lst.refresh(timer, users[timer->user_data->sockfd].timeout_phase());
 
     LOG_INFO("%s", "adjust timer once");
 }
 
 // 释放连接，删除计时器
+// 只在连接未投递给工作线程时调用：事件按EPOLLONESHOT注册，工作线程重新注册之前不会有该连接的事件
 void WebServer::deal_timer(util_timer *timer, int sockfd){
-    timer->cb_func(&users_timer[sockfd]);
-    if(timer){
-        utils.m_timer_lst.del_timer(timer);
+    // reactor模式下完成通知是异步的，连接可能已被对端关闭或超时释放，定时器已置空
+    if(!timer)
+        return;
+    users_timer[sockfd].timer = nullptr;
+    utils.m_timer_lst.del_timer(timer);
+    // 注销事件、关闭socket，并归还缓冲区、请求状态和文件映射
+    users[sockfd].close_conn();
+
+    LOG_INFO("close fd %d", sockfd);
+}
+
+// 超时释放连接；工作线程仍在处理时推迟一个时钟周期，不能在其下释放缓冲区
+void WebServer::deal_timeout(client_data *user_data){
+    int sockfd = user_data->sockfd;
+    if(users[sockfd].in_worker()){
+        user_data->timer->expire = time(NULL) + TIMESLOT;
+        return;
     }
+    // 定时器随后由链表释放，置空防止再次使用
+    user_data->timer = nullptr;
+    users[sockfd].close_conn();
+
+    LOG_INFO("timeout close fd %d", sockfd);
+}
+
+void WebServer::cb_func(client_data *user_data){
+    assert(user_data);
+    s_server->deal_timeout(user_data);
+}
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+// 将新连接交给子反应堆，单反应堆模式下直接在主循环中建立定时器
+void WebServer::dispatch_conn(int connfd, struct sockaddr_in client_address){
+    if(m_sub_reactor_num <= 0){
+        timer(connfd, client_address);
+        return;
+    }
+    // 轮询选择子反应堆
+    event_loop *reactor = m_sub_reactors[m_next_reactor];
+    m_next_reactor = (m_next_reactor + 1) % m_sub_reactor_num;
+    if(!reactor->dispatch(connfd, client_address)){
+        utils.show_error(connfd, "Internal server busy");
+    }
 }
 
 // 接受新客户连接
@@ -179,7 +422,7 @@ bool WebServer::dealclinetdata(){
             LOG_ERROR("%s", "Internal server busy");
             return false;
         }
-        timer(connfd, client_address);
+        dispatch_conn(connfd, client_address);
     }
     else{
         while(1){
@@ -193,7 +436,7 @@ bool WebServer::dealclinetdata(){
                 LOG_ERROR("%s", "Internal server busy");
                 break;
             }
-            timer(connfd, client_address);
+            dispatch_conn(connfd, client_address);
         }
         return false;
     }
@@ -235,20 +478,8 @@ void WebServer::dealwithread(int sockfd){
         }
 
         // 若监测到读事件，将该事件放入请求队列
+        // 工作线程处理完毕后经完成队列通知，事件循环不等待，继续分发其他fd
         m_pool->append(users + sockfd, 0);
-
-        // 等待工作线程读
-        while(true){
-            if(users[sockfd].improv == 1){
-                // 读失败
-                if(users[sockfd].timer_flag == 1){
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
     }
     // proactor
     else{
@@ -281,17 +512,6 @@ void WebServer::dealwithwrite(int sockfd){
         }
 
         m_pool->append(users + sockfd, 1);
-
-        while(true){
-            if(users[sockfd].improv == 1){
-                if(users[sockfd].timer_flag == 1){
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
     }
     else{
         // proactor
@@ -301,6 +521,9 @@ void WebServer::dealwithwrite(int sockfd){
             if(timer){
                 adjust_timer(timer);
             }
+            // 读缓冲中还有流水线请求，交给线程池继续处理
+            if(users[sockfd].has_buffered())
+                m_pool->append_p(users + sockfd);
         }
         else{
             deal_timer(timer, sockfd);
@@ -308,8 +531,96 @@ void WebServer::dealwithwrite(int sockfd){
     }
 }
 
+// 固定模式：连接只在主循环线程处理，持久ET注册下一次事件可能同时带读写就绪
+void WebServer::dealwithpinned(int sockfd, uint32_t events){
+    util_timer *timer = users_timer[sockfd].timer;
+    if(!timer)
+        return;
+    // 请求在线程池中处理，完成后重新读写，期间的边沿不会丢失
+    if(users[sockfd].in_worker())
+        return;
+
+    bool ok = true;
+    // 先发完上一个响应，再处理新数据
+    if(events & EPOLLOUT)
+        ok = users[sockfd].write();
+    if(ok && (events & EPOLLIN))
+        ok = users[sockfd].read_once();
+    // 发完一批响应后继续处理缓冲区中的流水线请求
+    if(ok)
+        ok = users[sockfd].process_inline();
+
+    if(ok){
+        adjust_timer(timer);
+        if(users[sockfd].wants_worker())
+            offload(sockfd);
+    }
+    else
+        deal_timer(timer, sockfd);
+}
+
+void WebServer::offload(int sockfd){
+    http_conn *conn = users + sockfd;
+    // improv在完成项被主循环取走前保持为1，期间不处理该连接的事件，超时也推迟释放
+    conn->improv.store(1, std::memory_order_relaxed);
+    completion_queue<http_conn> *done = m_completion;
+    bool ok = m_pool->submit([conn, done]{
+        conn->m_worker.store(task_pool::current_worker(), std::memory_order_relaxed);
+        conn->timer_flag.store(conn->process_buffer() < 0 ? 1 : 0, std::memory_order_relaxed);
+        done->push(conn);
+    }, conn->m_worker.load(std::memory_order_relaxed));
+    if(!ok){
+        LOG_ERROR("%s", "task queue full");
+        conn->improv.store(0, std::memory_order_relaxed);
+        deal_timer(users_timer[sockfd].timer, sockfd);
+    }
+}
+
+// 处理reactor模式下工作线程投递回来的完成项
+void WebServer::dealwithcompletion(){
+    http_conn *request = m_completion->pop_all();
+    while(request){
+        http_conn *next = request->m_done_next;
+        // 先清improv再读timer_flag：acquire与工作线程的release配对，
+        // 清零之后工作线程的新一次完成会重新入队，不会丢失
+        request->improv.exchange(0, std::memory_order_acq_rel);
+        int sockfd = request - users;
+        // 读写失败，关闭连接
+        if(request->timer_flag.exchange(0, std::memory_order_relaxed) == 1){
+            deal_timer(users_timer[sockfd].timer, sockfd);
+        }
+        // 固定模式：发送线程池生成的响应，读入期间到达的数据并继续处理
+        else if(m_conn_pinned){
+            dealwithpinned(sockfd, EPOLLIN | EPOLLOUT);
+        }
+        // 工作线程处理后连接可能进入了新阶段
+        else if(users_timer[sockfd].timer){
+            adjust_timer(users_timer[sockfd].timer);
+        }
+        request = next;
+    }
+}
+
+void WebServer::log_pool_stats(){
+    if(m_close_log || !m_pool)
+        return;
+    pool_stats cur = m_pool->stats();
+    uint64_t done = cur.tasks - m_last_stats.tasks;
+    uint64_t wait_us = done ? (cur.wait_ns - m_last_stats.wait_ns) / done / 1000 : 0;
+    uint64_t service_us = done ? (cur.service_ns - m_last_stats.service_ns) / done / 1000 : 0;
+    LOG_INFO("pool threads:%u depth:%llu tasks:%llu wait:%lluus service:%lluus", cur.threads,
+             (unsigned long long)cur.queue_depth, (unsigned long long)done,
+             (unsigned long long)wait_us, (unsigned long long)service_us);
+    m_last_stats = cur;
+}
+
 // 循环处理事件
 void WebServer::eventLoop(){
+    // 其他线程都已创建，主循环此时再绑核，新线程不会继承这个单核掩码
+    int cpu = cpu_affinity::get_instance()->loop_cpu(0);
+    if(cpu >= 0)
+        pin_thread(cpu);
+
     bool timeout = false;
     bool stop_server = false;
 
@@ -329,8 +640,15 @@ void WebServer::eventLoop(){
                 if(flag == false)
                     continue;
             }
+            // reactor模式工作线程完成通知
+            else if(m_completion && sockfd == m_completion->get_fd()){
+                dealwithcompletion();
+            }
             // 对端关闭
             else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+                // 固定模式下请求仍在线程池中，完成后读到对端关闭再释放
+                if(m_conn_pinned && users[sockfd].in_worker())
+                    continue;
                 // 服务器端关闭连接，移除对应的定时器
                 util_timer *timer = users_timer[sockfd].timer;
                 deal_timer(timer, sockfd);
@@ -341,6 +659,10 @@ void WebServer::eventLoop(){
                 if(flag == false)
                     LOG_ERROR("%s", "dealclientdata failure");
             }
+            // 固定模式下的客户连接
+            else if(m_conn_pinned){
+                dealwithpinned(sockfd, events[i].events);
+            }
             // 处理客户连接上接收到的数据
             else if(events[i].events & EPOLLIN){
                 dealwithread(sockfd);
@@ -354,6 +676,7 @@ void WebServer::eventLoop(){
         if(timeout){
             utils.timer_handler();
             LOG_INFO("%s", "timer tick");
+            log_pool_stats();
             timeout = false;
         }
     }
@@ -11,35 +11,76 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <netinet/tcp.h>
 
-#include "../threadpool/threadpool.h"
+#include "../threadpool/thradpool.h"
+#include "../threadpool/thread_affinity.h"
 #include "../http/http_conn.h"
+#include "sub_reactor.h"
+#include "uring_loop.h"
 
 const int MAX_FD = 65535;           //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; //最大事件数
 const int TIMESLOT = 5;             //最小超时单位
 
-class WebSever{
+class WebServer{
 public:
     WebServer(string user, string password, string database_name, const char *root,
               int port, int close_log, int async_log, int sql_num,
-              int thread_num, int actor_model, int trig_mode, int opt_linger);
+              int thread_num, int actor_model, int trig_mode, int opt_linger,
+              int sub_reactor_num = 0, int io_backend = 0, int conn_pinned = 0);
     ~WebServer();
 
     void log_write();
     void sql_pool();
     void thread_pool();
     
+    // 监听选项，需在eventListen之前调用
+    void set_listen(int backlog, int reuseport, int defer_accept, int fastopen);
+    // 静态文件发送方式，0 mmap+writev，1 sendfile零拷贝
+    void set_zero_copy(int zero_copy);
+    // 静态文件缓存大小，max_entries为0不启用
+    void set_file_cache(int max_mb, int max_entries);
+    // 小文件完整响应缓存，依赖文件缓存，budget_mb为0不启用
+    void set_response_cache(int budget_mb, int max_file_kb);
+    // 内容压缩：precompressed发送预先压缩的文件，budget_mb为在线压缩结果的缓存大小，0不启用
+    // 大小在[min_bytes, max_kb]之间的文本文件才在线压缩
+    void set_compression(int precompressed, int budget_mb, int min_bytes, int max_kb);
+    // 未配置路由的大消息体上限与溢出文件目录
+    void set_body_limit(int max_mb, const char *spill_dir);
+    // 静态文件响应报头：路径以prefix开头（相对资源根目录，如"/static/"）的文件使用给定的Content-Type和Cache-Control
+    // 空串表示不设置，多条规则取最长前缀，需在eventListen之前调用
+    void set_header_rule(const char *prefix, const char *content_type, const char *cache_control);
+    // 连接各阶段的超时（秒）：读请求头、读消息体、长连接空闲、发送停滞，max_requests为单连接请求数上限，0不限制
+    void set_timeouts(int header, int body, int idle, int write, int max_requests);
+    // 线程池请求队列，0互斥锁链表，1无锁环形队列，2每线程工作窃取队列
+    void set_thread_queue(int queue_mode);
+    // 线程池伸缩：thread_num为常驻线程数，排队时间超过target_wait_us时逐个增加到max_threads，增加的线程空闲idle_ms后退出
+    // max_threads不大于thread_num时线程数固定
+    void set_thread_limits(int max_threads, int target_wait_us, int idle_ms);
+    // 绑核，"0-3,8"形式的cpu列表，为空不绑定：主循环用loop_cpus第一个，子反应堆依次用后面的，工作线程依次用worker_cpus
+    void set_cpu_affinity(const char *loop_cpus, const char *worker_cpus);
     void eventListen();
     void eventLoop();
 
+    int create_listenfd();
     void timer(int connfd, struct sockaddr_in client_address);
     void adjust_timer(util_timer *timer);
     void deal_timer(util_timer *timer, int sockfd);
+    void deal_timeout(client_data *user_data);
+    // 定时器回调，在主循环的tick中执行
+    static void cb_func(client_data *user_data);
     bool dealclinetdata();
+    void dispatch_conn(int connfd, struct sockaddr_in client_address);
     bool dealwithsignal(bool& timeout, bool& stop_server);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
+    void dealwithpinned(int sockfd, uint32_t events);
+    // 固定模式下带处理函数的请求交给线程池，处理完经完成队列交回主循环发送
+    void offload(int sockfd);
+    void dealwithcompletion();
+    // 定时输出线程池在上一周期的线程数、队列深度与平均排队、执行时间
+    void log_pool_stats();
 
 private:
     // 基本配置
@@ -56,9 +97,32 @@ private:
     int m_listen_trig_mode; // 监听触发模式，0 LT，1 ET
     int m_conn_trig_mode;   // 连接触发模式，0 LT，1 ET
     int m_opt_linger;       // 优雅关闭链接，0不使用，1使用
+    int m_sub_reactor_num;  // 子反应堆数量，0表示单反应堆
+    int m_io_backend;       // I/O引擎，0 epoll，1 io_uring（内核缺少所需特性时退回epoll）
+    int m_conn_pinned;      // 连接固定在所属循环线程处理，持久ET注册，不再逐次epoll_ctl(MOD)，0不使用，1使用
+    int m_backlog;          // listen全连接队列长度
+    int m_reuseport;        // SO_REUSEPORT，多反应堆下每个子反应堆独立监听，0不使用，1使用
+    int m_defer_accept;     // TCP_DEFER_ACCEPT秒数，数据到达前不唤醒accept，0不使用
+    int m_fastopen;         // TCP_FASTOPEN队列长度，0不使用
+    int m_cache_mb;         // 文件缓存总大小上限，MB
+    int m_cache_entries;    // 文件缓存条目数上限，0不启用
+    int m_resp_cache_mb;    // 响应缓存内存预算，MB，0不启用
+    int m_resp_file_kb;     // 可缓存完整响应的文件大小上限，KB
+    int m_compress_mb;      // 在线压缩结果缓存大小，MB，0不启用
+    int m_compress_min;     // 在线压缩的文件大小下限，字节
+    int m_compress_max_kb;  // 在线压缩的文件大小上限，KB
+    int m_body_max_mb;      // 大消息体上限，MB
+    string m_spill_dir;     // 大消息体溢出文件目录
+    int m_timeslot;         // 定时器检查周期，不超过最短的超时
+    int m_queue_mode;       // 线程池请求队列实现，见QUEUE_MODE
+    int m_thread_max;       // 线程池线程数上限
+    int m_target_wait_us;   // 线程池排队时间目标，微秒
+    int m_idle_ms;          // 增加的线程空闲多久后退出，毫秒
+    pool_stats m_last_stats;    // 上次输出时的线程池统计
 
     connection_pool *m_connPool;    // 数据库连接池
     threadpool<http_conn> *m_pool;  // 线程池
+    completion_queue<http_conn> *m_completion;  // reactor模式或固定模式下工作线程的完成队列
 
     http_conn *users;               // 客户请求结构
     client_data *users_timer;       // 客户数据结构
@@ -69,6 +133,9 @@ private:
 
     int m_epollfd;                          // epoll句柄
     epoll_event events[MAX_EVENT_NUMBER];   // 事件列表
+
+    event_loop **m_sub_reactors;    // 子反应堆数组，主反应堆只负责accept，按I/O引擎为sub_reactor或uring_loop
+    int m_next_reactor;             // 轮询分发的下一个子反应堆
 };
 
 
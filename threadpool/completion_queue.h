@@ -0,0 +1,72 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <atomic>
+#include <exception>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// 完成队列：工作线程处理完请求后投递回事件循环
+// 多生产者单消费者的无锁侵入式栈，T需要提供 T *m_done_next 成员，入队出队都不分配内存
+// 只有队列由空变为非空时才写eventfd，事件循环把eventfd注册到epoll上统一处理
+template <typename T>
+class completion_queue{
+public:
+    completion_queue():m_head(nullptr){
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(m_eventfd < 0){
+            throw std::exception();
+        }
+    }
+    ~completion_queue(){
+        close(m_eventfd);
+    }
+
+    int get_fd() const{
+        return m_eventfd;
+    }
+
+    // 工作线程调用：压入完成项，release保证请求对象上的写入对事件循环可见
+    void push(T *item){
+        T *old = m_head.load(std::memory_order_relaxed);
+        do{
+            item->m_done_next = old;
+        }while(!m_head.compare_exchange_weak(old, item, std::memory_order_release, std::memory_order_relaxed));
+
+        // 原本为空说明事件循环可能在等待，需要唤醒
+        if(old == nullptr){
+            uint64_t one = 1;
+            ssize_t ret = write(m_eventfd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    // 事件循环调用：一次取出全部完成项，按完成先后顺序返回链表头
+    T* pop_all(){
+        // 必须先清eventfd再摘链表，否则在两步之间入队的完成项可能丢失唤醒
+        uint64_t cnt;
+        ssize_t ret = read(m_eventfd, &cnt, sizeof(cnt));
+        (void)ret;
+
+        T *list = m_head.exchange(nullptr, std::memory_order_acquire);
+        // 栈是后进先出，反转为先进先出
+        T *ordered = nullptr;
+        while(list){
+            T *next = list->m_done_next;
+            list->m_done_next = ordered;
+            ordered = list;
+            list = next;
+        }
+        return ordered;
+    }
+
+private:
+    completion_queue(const completion_queue&) = delete;
+    completion_queue& operator=(const completion_queue&) = delete;
+
+    std::atomic<T*> m_head;     // 栈顶
+    int m_eventfd;              // 唤醒事件循环
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include "../locker/locker.h"
+
+// 有界多生产者多消费者无锁环形队列（Vyukov）
+// 每个槽位带序号，生产者和消费者各自CAS推进位置后只访问自己占到的槽位，入队出队都不分配内存
+// 消费者取不到任务时在futex上休眠，生产者只在有消费者休眠时才发起系统调用唤醒
+template <typename T>
+class mpmc_queue{
+public:
+    // 容量向上取整为2的幂，槽位一次分配好
+    explicit mpmc_queue(size_t capacity):m_enqueue(0), m_dequeue(0), m_waiters(0){
+        size_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_cells = new cell[size];
+        for(size_t i = 0; i < size; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    ~mpmc_queue(){
+        delete[] m_cells;
+    }
+
+    size_t capacity() const{
+        return m_mask + 1;
+    }
+
+    // 入队，队列满返回false，此时item保持不变
+    template <typename U>
+    bool push(U &&item){
+        if(!try_push(std::forward<U>(item)))
+            return false;
+        // 与pop中登记休眠的全屏障配对：要么这里看到有人休眠，要么休眠前的重试能取到本任务
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_waiters.load(std::memory_order_relaxed) > 0)
+            m_futex.wake();
+        return true;
+    }
+
+    // 出队，不阻塞
+    bool try_pop(T &item){
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        while(true){
+            cell *c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0){
+                if(m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            // 槽位还没有写入，队列为空
+            else if(diff < 0)
+                return false;
+            else
+                pos = m_dequeue.load(std::memory_order_relaxed);
+        }
+        cell *c = &m_cells[pos & m_mask];
+        item = std::move(c->data);
+        // 槽位交给下一圈的生产者
+        c->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列为空时先自旋重试，仍取不到则休眠等待唤醒
+    // timeout_ms<0时一直等到取出任务；否则至多休眠一次timeout_ms，醒来后仍取不到返回false
+    bool pop(T &item, int timeout_ms = -1){
+        while(true){
+            for(int i = 0; i < SPIN; ++i){
+                if(try_pop(item))
+                    return true;
+            }
+            // 先取唤醒序号再登记，之后入队的生产者一定会改变序号，不会错过唤醒
+            uint32_t key = m_futex.prepare();
+            m_waiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(try_pop(item)){
+                m_waiters.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            m_futex.wait(key, timeout_ms);
+            m_waiters.fetch_sub(1, std::memory_order_relaxed);
+            // 醒来后再取一次，取不到说明超时或任务被其他消费者取走
+            if(timeout_ms >= 0)
+                return try_pop(item);
+        }
+    }
+
+    // 队列中的任务数，并发修改时为近似值
+    size_t size() const{
+        size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+        size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+private:
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    template <typename U>
+    bool try_push(U &&item){
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        while(true){
+            cell *c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0){
+                if(m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            // 槽位上一圈的任务还没被取走，队列已满
+            else if(diff < 0)
+                return false;
+            else
+                pos = m_enqueue.load(std::memory_order_relaxed);
+        }
+        cell *c = &m_cells[pos & m_mask];
+        c->data = std::forward<U>(item);
+        // release：任务及入队前对请求对象的写入对取到它的消费者可见
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static const int SPIN = 64;     // 休眠前的重试次数
+    static const size_t CACHE_LINE = 64;
+
+    struct cell{
+        std::atomic<size_t> seq;    // 等于位置表示可写入，等于位置+1表示可读取
+        T data;
+    };
+
+    // 生产者、消费者位置与唤醒状态各占一条缓存行，避免相互争用
+    cell *m_cells;
+    size_t m_mask;
+    char m_pad0[CACHE_LINE];
+    std::atomic<size_t> m_enqueue;
+    char m_pad1[CACHE_LINE];
+    std::atomic<size_t> m_dequeue;
+    char m_pad2[CACHE_LINE];
+    futex_word m_futex;             // 休眠的消费者在此等待
+    std::atomic<int> m_waiters;     // 休眠中的消费者数
+    char m_pad3[CACHE_LINE];
+};
+
+#endif
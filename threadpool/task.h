@@ -0,0 +1,134 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+// 线程池任务：只可移动的无参可调用对象
+// 不超过INLINE_SIZE且可无异常移动的可调用对象直接存放在任务内部，入队出队只移动不分配内存
+// 更大的可调用对象退回堆上存放；与std::function不同，可以持有std::packaged_task这类只可移动的对象
+class task{
+public:
+    static const size_t INLINE_SIZE = 40;
+
+    task():m_ops(nullptr){}
+
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, task>::value>::type>
+    task(F &&f){
+        typedef typename std::decay<F>::type func;
+        init<func>(std::forward<F>(f), std::integral_constant<bool, fits<func>()>());
+    }
+
+    task(task &&other) noexcept:m_ops(other.m_ops){
+        if(m_ops){
+            m_ops->move(m_storage, other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    task& operator=(task &&other) noexcept{
+        if(this != &other){
+            reset();
+            m_ops = other.m_ops;
+            if(m_ops){
+                m_ops->move(m_storage, other.m_storage);
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~task(){
+        reset();
+    }
+
+    explicit operator bool() const{
+        return m_ops != nullptr;
+    }
+
+    void operator()(){
+        m_ops->invoke(m_storage);
+    }
+
+    // 释放持有的可调用对象
+    void reset(){
+        if(m_ops){
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    struct ops{
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src);     // 移动到dst并销毁src中的对象
+        void (*destroy)(void *storage);
+    };
+
+    template <typename F>
+    static constexpr bool fits(){
+        return sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(void *) &&
+               std::is_nothrow_move_constructible<F>::value;
+    }
+
+    template <typename func, typename F>
+    void init(F &&f, std::true_type){
+        new (m_storage) func(std::forward<F>(f));
+        m_ops = &inline_ops<func>::table;
+    }
+    template <typename func, typename F>
+    void init(F &&f, std::false_type){
+        *reinterpret_cast<func **>(m_storage) = new func(std::forward<F>(f));
+        m_ops = &heap_ops<func>::table;
+    }
+
+    template <typename F>
+    struct inline_ops{
+        static void invoke(void *storage){
+            (*static_cast<F *>(storage))();
+        }
+        static void move(void *dst, void *src){
+            F *f = static_cast<F *>(src);
+            new (dst) F(std::move(*f));
+            f->~F();
+        }
+        static void destroy(void *storage){
+            static_cast<F *>(storage)->~F();
+        }
+        static const ops table;
+    };
+
+    // 内部只存放指针
+    template <typename F>
+    struct heap_ops{
+        static void invoke(void *storage){
+            (**static_cast<F **>(storage))();
+        }
+        static void move(void *dst, void *src){
+            *static_cast<F **>(dst) = *static_cast<F **>(src);
+        }
+        static void destroy(void *storage){
+            delete *static_cast<F **>(storage);
+        }
+        static const ops table;
+    };
+
+    alignas(void *) unsigned char m_storage[INLINE_SIZE];
+    const ops *m_ops;
+};
+
+template <typename F>
+const task::ops task::inline_ops<F>::table = {&task::inline_ops<F>::invoke, &task::inline_ops<F>::move,
+                                              &task::inline_ops<F>::destroy};
+
+template <typename F>
+const task::ops task::heap_ops<F>::table = {&task::heap_ops<F>::invoke, &task::heap_ops<F>::move,
+                                            &task::heap_ops<F>::destroy};
+
+#endif
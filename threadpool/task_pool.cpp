@@ -0,0 +1,361 @@
+#include <new>
+#include <cstdio>
+#include <exception>
+#include <time.h>
+#include <unistd.h>
+
+#include "task_pool.h"
+#include "thread_affinity.h"
+
+// 工作窃取模式下本线程的编号
+static thread_local int t_worker = -1;
+
+// 单调时钟，纳秒
+static inline int64_t now_ns(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// 构造线程池，创建常驻线程；可伸缩时另起监控线程
+task_pool::task_pool(uint32_t thread_number, uint32_t max_request, int queue_mode,
+                     uint32_t max_threads, int target_wait_us, int idle_ms)
+:m_thread_number(thread_number),m_max_threads(max_threads > thread_number ? max_threads : thread_number),
+ m_max_request(max_request),m_target_wait_ns((int64_t)target_wait_us * 1000),m_idle_ms(idle_ms),m_live(0),m_stop(0),
+ m_ring(nullptr),m_workers(nullptr),m_next_worker(0),m_sleepers(0){
+    if(thread_number <= 0 || max_request <= 0){
+        throw std::exception();
+    }
+    // 槽位在线程启动前分配好，之后入队出队不再分配内存
+    if(queue_mode == QUEUE_LOCK_FREE)
+        m_ring = new mpmc_queue<pool_item>(max_request);
+    // 任务总量上限平分到常驻线程的收件箱，配置了绑核时每个线程的槽位与队列放在其cpu所在的NUMA节点上
+    else if(queue_mode == QUEUE_STEALING){
+        m_workers = new ws_worker*[m_max_threads];
+        for(uint32_t i = 0; i < m_max_threads; ++i){
+            void *addr = numa_alloc(sizeof(ws_worker), cpu_affinity::get_instance()->worker_node(i));
+            if(!addr)
+                throw std::bad_alloc();
+            size_t capacity = i < thread_number ? (max_request + thread_number - 1) / thread_number : 2;
+            m_workers[i] = new (addr) ws_worker(capacity);
+        }
+    }
+    m_slots = new worker_slot[m_max_threads];
+    for(uint32_t i = 0; i < m_max_threads; ++i){
+        m_slots[i].pool = this;
+        m_slots[i].index = i;
+    }
+    m_threads = new pthread_t[m_max_threads];
+    for(uint32_t i = 0; i < thread_number; i++){
+        m_slots[i].running.store(1, std::memory_order_relaxed);
+        m_live.fetch_add(1, std::memory_order_relaxed);
+        // 内存单元、线程属性(NULL)、工作函数，传递参数（线程编号）
+        if(pthread_create(m_threads + i, NULL, worker, m_slots + i) != 0){
+            delete[] m_threads;
+            throw std::exception();
+        }
+        //分离主线程与子线程，子线程结束后资源自动回收
+        if(pthread_detach(m_threads[i]) != 0){
+            delete[] m_threads;
+            throw std::exception();
+        }
+    }
+    if(m_max_threads > m_thread_number){
+        if(pthread_create(&m_monitor, NULL, monitor, this) != 0){
+            delete[] m_threads;
+            throw std::exception();
+        }
+    }
+}
+
+// 析构，释放线程数组与队列
+task_pool::~task_pool(){
+    if(m_max_threads > m_thread_number){
+        m_stop.store(1, std::memory_order_relaxed);
+        pthread_join(m_monitor, NULL);
+    }
+    delete[] m_threads;
+    delete[] m_slots;
+    delete m_ring;
+    if(m_workers){
+        for(uint32_t i = 0; i < m_max_threads; ++i){
+            m_workers[i]->~ws_worker();
+            numa_free(m_workers[i], sizeof(ws_worker));
+        }
+        delete[] m_workers;
+    }
+}
+
+int task_pool::current_worker(){
+    return t_worker;
+}
+
+pool_stats task_pool::stats() const{
+    pool_stats st;
+    st.threads = m_live.load(std::memory_order_relaxed);
+    st.queue_depth = queue_depth();
+    st.tasks = st.wait_ns = st.service_ns = 0;
+    for(uint32_t i = 0; i < m_max_threads; ++i){
+        st.tasks += m_slots[i].tasks.load(std::memory_order_relaxed);
+        st.wait_ns += m_slots[i].wait_ns.load(std::memory_order_relaxed);
+        st.service_ns += m_slots[i].service_ns.load(std::memory_order_relaxed);
+    }
+    return st;
+}
+
+uint64_t task_pool::queue_depth() const{
+    if(m_ring)
+        return m_ring->size();
+    if(m_workers){
+        uint64_t depth = 0;
+        for(uint32_t i = 0; i < m_thread_number; ++i)
+            depth += m_workers[i]->inbox.size() + m_workers[i]->deque.size();
+        return depth;
+    }
+    // list::size为常数时间，加锁只为读到一致的值
+    mutexlocker &locker = const_cast<mutexlocker &>(m_queuelocker);
+    locker.lock();
+    uint64_t depth = m_workqueue.size();
+    locker.unlock();
+    return depth;
+}
+
+// 添加任务，并通知工作线程
+bool task_pool::submit(task &&t, int affinity){
+    pool_item item;
+    item.work = std::move(t);
+    item.enqueued = now_ns();
+    bool ok;
+    if(m_ring)
+        ok = m_ring->push(std::move(item));
+    else if(m_workers)
+        ok = dispatch(item, affinity);
+    else{
+        // 任务队列是临界区，加互斥锁
+        m_queuelocker.lock();
+        ok = m_workqueue.size() < m_max_request;
+        if(ok)
+            m_workqueue.push_back(std::move(item));
+        m_queuelocker.unlock();
+        // 增加信号量，表示有任务要处理
+        if(ok)
+            m_queuestat.post();
+    }
+    if(!ok)
+        t = std::move(item.work);
+    return ok;
+}
+
+// 工作线程运行
+void* task_pool::worker(void *arg){
+    // 参数为线程编号所在的项，从中取得线程池
+    worker_slot *slot = (worker_slot *)arg;
+    slot->pool->run(slot->index);
+    return nullptr;
+}
+
+void* task_pool::monitor(void *arg){
+    task_pool *pool = (task_pool *)arg;
+    pool->watch();
+    return nullptr;
+}
+
+// 每个周期取一次统计：队列非空而这段时间没有任务执行完，说明线程都阻塞在慢任务上；
+// 或者这段时间执行的任务平均排队超过目标，都增加一个线程
+// 新线程只由这里创建，继承本线程未绑核的cpu掩码，不会继承事件循环线程的单核掩码
+void task_pool::watch(){
+    set_thread_name("pool-monitor");
+    int64_t period_us = m_target_wait_ns / 1000;
+    if(period_us < 1000)
+        period_us = 1000;
+    pool_stats last = stats();
+    while(!m_stop.load(std::memory_order_relaxed)){
+        usleep(period_us);
+        pool_stats cur = stats();
+        uint64_t done = cur.tasks - last.tasks;
+        if(cur.queue_depth > 0 &&
+           (done == 0 || (int64_t)((cur.wait_ns - last.wait_ns) / done) > m_target_wait_ns))
+            grow();
+        last = cur;
+    }
+}
+
+bool task_pool::grow(){
+    uint32_t live = m_live.load(std::memory_order_relaxed);
+    do{
+        if(live >= m_max_threads)
+            return false;
+    }while(!m_live.compare_exchange_weak(live, live + 1, std::memory_order_relaxed));
+    // 退出的线程先归还编号再减少计数，计数未满时一定有空闲编号
+    for(uint32_t i = m_thread_number; i < m_max_threads; ++i){
+        int idle = 0;
+        if(!m_slots[i].running.compare_exchange_strong(idle, 1, std::memory_order_acquire))
+            continue;
+        if(pthread_create(m_threads + i, NULL, worker, m_slots + i) != 0){
+            m_slots[i].running.store(0, std::memory_order_release);
+            break;
+        }
+        pthread_detach(m_threads[i]);
+        return true;
+    }
+    m_live.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool task_pool::dispatch(pool_item &item, int target){
+    int n = m_thread_number;
+    if(target < 0 || target >= n)
+        target = (m_next_worker.fetch_add(1, std::memory_order_relaxed) & 0x7fffffff) % n;
+    for(int i = 0; i < n; ++i){
+        ws_worker *w = m_workers[(target + i) % n];
+        if(!w->inbox.push(std::move(item)))
+            continue;
+        // 与take_stealing中登记休眠的全屏障配对
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(w->sleeping.load(std::memory_order_relaxed)){
+            w->futex.wake();
+        }
+        // 目标线程正忙，唤醒一个空闲线程来窃取
+        else if(m_sleepers.load(std::memory_order_relaxed) > 0){
+            for(int j = 0; j < (int)m_max_threads; ++j){
+                if(m_workers[j]->sleeping.load(std::memory_order_relaxed)){
+                    m_workers[j]->futex.wake();
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+// 从槽位移出任务并释放槽位，release保证所属线程复用槽位时看到任务已移出
+template <typename T>
+static inline void release_slot(T &item, T &work, std::atomic<int> &busy){
+    item = std::move(work);
+    busy.store(0, std::memory_order_release);
+}
+
+bool task_pool::find(int self, pool_item &item){
+    ws_worker *me = m_workers[self];
+    ws_slot *slot;
+    if(me->deque.take(slot)){
+        release_slot(item, slot->work, slot->busy);
+        return true;
+    }
+    // 双端队列已空，从收件箱取一个执行，再成批搬入一些供自己和窃取者使用
+    // 队列为空时才搬入且BATCH小于DEQUE_SIZE，压入不会失败
+    if(me->inbox.try_pop(item)){
+        for(int i = 0; i < BATCH; ++i){
+            slot = nullptr;
+            for(int j = 0; j < SLOT_NUM && !slot; ++j){
+                ws_slot *s = &me->slots[(me->next_slot + j) % SLOT_NUM];
+                if(!s->busy.load(std::memory_order_acquire))
+                    slot = s;
+            }
+            if(!slot || !me->inbox.try_pop(slot->work))
+                break;
+            me->next_slot = (slot - me->slots + 1) % SLOT_NUM;
+            slot->busy.store(1, std::memory_order_relaxed);
+            me->deque.push(slot);
+        }
+        return true;
+    }
+    // 从常驻线程双端队列的顶部窃取，最后再取它们收件箱里还没搬入的任务；增加的线程队列总为空，不用看
+    int n = m_thread_number;
+    for(int i = 1; i <= n; ++i){
+        int victim = (self + i) % n;
+        if(victim != self && m_workers[victim]->deque.steal(slot)){
+            release_slot(item, slot->work, slot->busy);
+            return true;
+        }
+    }
+    for(int i = 1; i <= n; ++i){
+        int victim = (self + i) % n;
+        if(victim != self && m_workers[victim]->inbox.try_pop(item))
+            return true;
+    }
+    return false;
+}
+
+bool task_pool::take_stealing(int self, pool_item &item, int timeout_ms){
+    ws_worker *me = m_workers[self];
+    while(true){
+        for(int i = 0; i < SPIN; ++i){
+            if(find(self, item))
+                return true;
+        }
+        // 先取唤醒序号再登记休眠，之后投递的任务一定能被重试看到或唤醒本线程
+        uint32_t key = me->futex.prepare();
+        me->sleeping.store(1, std::memory_order_relaxed);
+        m_sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool found = find(self, item);
+        if(!found)
+            me->futex.wait(key, timeout_ms);
+        me->sleeping.store(0, std::memory_order_relaxed);
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        if(found)
+            return true;
+        if(timeout_ms >= 0)
+            return find(self, item);
+    }
+}
+
+bool task_pool::take(int self, pool_item &item, int timeout_ms){
+    if(m_workers)
+        return take_stealing(self, item, timeout_ms);
+    // 无锁队列为空时在队列内部休眠
+    if(m_ring)
+        return m_ring->pop(item, timeout_ms);
+    // 信号量阻塞，等待任务
+    if(timeout_ms < 0)
+        m_queuestat.wait();
+    else if(!m_queuestat.timewait(timeout_ms))
+        return false;
+    // 请求队列临界区，加互斥锁
+    m_queuelocker.lock();
+    if(m_workqueue.empty()){
+        m_queuelocker.unlock();
+        return false;
+    }
+    // 从请求队列取第一个任务
+    item = std::move(m_workqueue.front());
+    m_workqueue.pop_front();
+    m_queuelocker.unlock();
+    return true;
+}
+
+// 工作函数，index小于m_thread_number的是常驻线程，其余为增加的线程，空闲超过m_idle_ms后退出
+void task_pool::run(int index){
+    char name[16];
+    snprintf(name, sizeof(name), "worker-%d", index);
+    place_thread(name, cpu_affinity::get_instance()->worker_cpu(index));
+    int self = m_workers ? index : -1;
+    t_worker = self;
+    bool elastic = index >= (int)m_thread_number;
+    worker_slot &slot = m_slots[index];
+    pool_item item;
+    int64_t idle_since = now_ns();
+    while(true){
+        if(!take(self, item, elastic ? m_idle_ms : -1)){
+            if(elastic && now_ns() - idle_since >= (int64_t)m_idle_ms * 1000000)
+                break;
+            continue;
+        }
+        int64_t start = now_ns();
+        item.work();
+        // 及时释放任务持有的资源
+        item.work.reset();
+        int64_t end = now_ns();
+        // 只有本线程写入，不需要原子加
+        slot.tasks.store(slot.tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        slot.wait_ns.store(slot.wait_ns.load(std::memory_order_relaxed) + (start - item.enqueued), std::memory_order_relaxed);
+        slot.service_ns.store(slot.service_ns.load(std::memory_order_relaxed) + (end - start), std::memory_order_relaxed);
+        idle_since = end;
+    }
+    // 先归还编号再减少计数，见grow
+    t_worker = -1;
+    slot.running.store(0, std::memory_order_release);
+    m_live.fetch_sub(1, std::memory_order_relaxed);
+}
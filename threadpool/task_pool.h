@@ -0,0 +1,154 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <list>
+#include <future>
+#include <atomic>
+#include <utility>
+#include <stdint.h>
+#include <pthread.h>
+#include "../locker/locker.h"
+#include "task.h"
+#include "mpmc_queue.h"          // 无锁请求队列
+#include "ws_deque.h"            // 工作窃取双端队列
+
+// 请求队列实现
+enum QUEUE_MODE{
+    QUEUE_LOCKED = 0,   // 互斥锁保护的链表加信号量
+    QUEUE_LOCK_FREE,    // 有界无锁环形队列，空闲时futex休眠
+    QUEUE_STEALING      // 每个工作线程一个收件箱和一个工作窃取双端队列，任务优先交给指定的亲和线程
+};
+
+// 线程池运行统计，时间单位为纳秒，均为启动以来的累计值，取两次之差得到区间内的平均值
+struct pool_stats{
+    uint32_t threads;       // 当前线程数
+    uint64_t queue_depth;   // 排队中的任务数，近似值
+    uint64_t tasks;         // 已执行完的任务数
+    uint64_t wait_ns;       // 这些任务从提交到开始执行的总时间
+    uint64_t service_ns;    // 这些任务的总执行时间
+};
+
+// 通用任务线程池：连接处理、压缩、数据库查询、文件I/O等任务共用一组工作线程
+// 任务在工作线程中执行，不应抛出异常；需要结果或异常的用submit_future
+// 线程数可在thread_number到max_threads之间伸缩：排队时间超过目标时增加线程，增加的线程空闲一段时间后退出
+class task_pool{
+public:
+    // thread_number常驻工作线程数，max_request队列中最多的任务数，queue_mode见QUEUE_MODE
+    // max_threads线程数上限，不大于thread_number时线程数固定
+    // target_wait_us排队时间目标，idle_ms增加的线程空闲多久后退出
+    task_pool(uint32_t thread_number, uint32_t max_request, int queue_mode,
+              uint32_t max_threads = 0, int target_wait_us = 5000, int idle_ms = 10000);
+    virtual ~task_pool();
+
+    // 提交任务，affinity为工作窃取模式下优先执行的线程编号，-1不指定；队列满返回false，此时t保持不变
+    bool submit(task &&t, int affinity = -1);
+    // 提交任务并通过future取得结果，队列满时future中为异常
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit_future(F f){
+        typedef typename std::result_of<F()>::type result;
+        std::packaged_task<result()> job(std::move(f));
+        std::future<result> fut = job.get_future();
+        task t(std::move(job));
+        if(!submit(std::move(t))){
+            std::promise<result> failed;
+            failed.set_exception(std::make_exception_ptr(std::runtime_error("task queue full")));
+            return failed.get_future();
+        }
+        return fut;
+    }
+    // 当前线程在工作窃取模式下的编号，不是本池的工作线程或未使用工作窃取时为-1
+    static int current_worker();
+    // 当前线程数、队列深度与累计的排队、执行时间
+    pool_stats stats() const;
+
+private:
+    task_pool(const task_pool&) = delete;
+    task_pool& operator=(const task_pool&) = delete;
+
+    // 工作线程运行函数，需要是静态函数，因为pthread_create()第三个参数是(void *)，而成员函数会编译为带有this指针参数，从而不能匹配
+    // 静态成员函数没有this指针，但不能访问非静态成员变量，因此在内部调用run
+    static void* worker(void *arg);
+    void run(int index);
+    // 伸缩线程池时的监控线程，每个周期比较排队时间与目标
+    static void* monitor(void *arg);
+    void watch();
+    // 占用一个空闲编号并创建线程，已到上限返回false
+    bool grow();
+    // 队列中的任务数
+    uint64_t queue_depth() const;
+
+    // 队列中的任务，带入队时刻用于统计排队时间
+    struct pool_item{
+        pool_item():enqueued(0){}
+        task work;
+        int64_t enqueued;   // 单调时钟，纳秒
+    };
+
+    // 取出一个任务；timeout_ms<0时阻塞等待，否则等待超时或被虚假唤醒时返回false
+    bool take(int self, pool_item &item, int timeout_ms);
+    // 工作窃取模式：投递到目标线程的收件箱，满了依次尝试其他线程
+    bool dispatch(pool_item &item, int target);
+    // 工作窃取模式：本线程双端队列、收件箱、窃取其他线程，都没有返回false
+    bool find(int self, pool_item &item);
+    bool take_stealing(int self, pool_item &item, int timeout_ms);
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    // 每个线程编号一项，线程启动时取得编号，增加的线程退出时归还
+    struct worker_slot{
+        worker_slot():pool(nullptr), index(0), running(0), tasks(0), wait_ns(0), service_ns(0){}
+        task_pool *pool;
+        int index;
+        std::atomic<int> running;       // 编号是否被线程占用
+        // 只由占用该编号的线程写入，监控线程和stats读取
+        std::atomic<uint64_t> tasks;
+        std::atomic<uint64_t> wait_ns;
+        std::atomic<uint64_t> service_ns;
+        char pad[CACHE_LINE];           // 各线程的统计不共享缓存行
+    };
+
+    uint32_t m_thread_number;   // 常驻线程数，编号小于它的线程不退出
+    uint32_t m_max_threads;     // 线程数上限
+    uint32_t m_max_request; // 请求队列中的最大请求数
+    int64_t m_target_wait_ns;   // 排队时间目标
+    int m_idle_ms;              // 增加的线程空闲多久后退出
+    std::atomic<uint32_t> m_live;   // 当前线程数
+    worker_slot *m_slots;       // 大小为m_max_threads
+    pthread_t *m_threads;   // 线程数组，大小为m_max_threads
+    pthread_t m_monitor;        // 监控线程，析构时等它退出，不再读取统计与队列
+    std::atomic<int> m_stop;
+    std::list<pool_item> m_workqueue;  // 请求队列
+    mutexlocker m_queuelocker;  //互斥锁
+    semaphore m_queuestat;      // 是否有任务处理信号量
+    mpmc_queue<pool_item> *m_ring;   // 无锁请求队列，为空表示使用加锁链表
+
+    // 双端队列只能存放可原子读写的指针，任务本身放在所属线程的槽位中
+    // 所属线程占用空闲槽位放入任务，取到槽位的线程移出任务后释放槽位
+    struct ws_slot{
+        ws_slot():busy(0){}
+        pool_item work;
+        std::atomic<int> busy;
+    };
+    static const int DEQUE_SIZE = 64;
+    static const int SLOT_NUM = 2 * DEQUE_SIZE;   // 窃取者移出任务期间槽位仍被占用，多留一倍
+    static const int BATCH = 32;    // 每次从收件箱搬入双端队列的任务数
+    static const int SPIN = 16;     // 休眠前的重试轮数
+
+    // 工作窃取模式下每个工作线程的队列与休眠状态
+    struct ws_worker{
+        explicit ws_worker(size_t capacity):inbox(capacity), deque(DEQUE_SIZE), next_slot(0), sleeping(0){}
+        mpmc_queue<pool_item> inbox;    // 投递给本线程的任务
+        ws_deque<ws_slot*> deque;   // 从收件箱成批取出的任务，其他线程可从顶部窃取
+        ws_slot slots[SLOT_NUM];
+        int next_slot;              // 下次查找空闲槽位的起点，只有所属线程访问
+        futex_word futex;           // 本线程休眠时在此等待
+        std::atomic<int> sleeping;  // 是否正在休眠
+    };
+    // 为空表示不使用工作窃取；按m_max_threads分配，增加的线程不接收投递，只窃取常驻线程的任务
+    ws_worker **m_workers;
+    std::atomic<int> m_next_worker; // 没有亲和线程的任务轮询分配
+    std::atomic<int> m_sleepers;    // 休眠中的工作线程数
+};
+
+#endif
@@ -1,167 +1,103 @@
 #ifndef THRADPOOL_H
 #define THRADPOOL_H
 
-#include <list>     // 请求队列
 #include <cstdio>
 #include <exception>
-#include <pthread.h>
-#include "../locker/locker.h"   // 线程同步锁封装类
-#include "../CGImysql/sql_connection_pool.h"
+#include "task_pool.h"           // 通用任务线程池
+#include "completion_queue.h"    // reactor模式完成通知
 
-// 线程池模板类
+// 连接处理线程池：把连接的读写处理包装成任务提交给通用线程池
+// 数据库连接不在这里取出，只有需要的路由处理函数才向连接池借用
 template <typename T>
-class threadpool{
+class threadpool : public task_pool{
 public:
     // thread_number线程池中线程的数量
-    // connPool是数据库连接池指针
     // max_request队列中最大请求数量
-    threadpool(int actor_model,connection_pool *connPool, uint32_t thread_number, uint32_t max_request = 100000);
-    ~threadpool();
+    // queue_mode请求队列实现，见QUEUE_MODE
+    // max_threads、target_wait_us、idle_ms为伸缩参数，见task_pool
+    threadpool(int actor_model, uint32_t thread_number, uint32_t max_request = 100000,
+               int queue_mode = QUEUE_LOCKED, uint32_t max_threads = 0, int target_wait_us = 5000,
+               int idle_ms = 10000);
     bool append(T *request, int state);
     bool append_p(T *request);
+    // reactor模式下处理完成的请求投递到该队列，由事件循环收尾
+    void set_completion(completion_queue<T> *completion){
+        m_completion = completion;
+    }
 
 private:
-    // 工作线程运行函数，需要是静态函数，因为pthread_create()第三个参数是(void *)，而成员函数会编译为带有this指针参数，从而不能匹配
-    // 静态成员函数没有this指针，但不能访问非静态成员变量，因此在内部调用run
-    static void* worker(void *arg);
-    void run();
+    // 在工作线程中处理一个连接
+    void handle(T *request);
 
 private:
     int m_actor_model;  // 处理模式 1.reactor 0.proactor
-    connection_pool *m_connPool;    // 数据库连接
-    uint32_t m_thread_number;   // 线程池中的最大线程数
-    uint32_t m_max_request; // 请求队列中的最大请求数
-    pthread_t *m_threads;   // 线程数组，大小为m_thread_number
-    std::list<T*> m_workqueue;  // 请求队列
-    mutexlocker m_queuelocker;  //互斥锁
-    semaphore m_queuestat;      // 是否有任务处理信号量
-
+    completion_queue<T> *m_completion;  // reactor模式完成队列
 };
 
 // 构造线程池，创建线程
 // 类成员函数参数默认值只在定义或声明其中一处对同一个参数设置
 template <typename T>
-threadpool<T>::threadpool(int actor_model, connection_pool *connPoll, uint32_t thread_number,uint32_t max_request)
-:m_actor_model(actor_model),m_connPool(connPoll),m_thread_number(thread_number),m_max_request(max_request){
-    if(thread_number <= 0 || max_request <= 0){
-        throw std::exception();
-    }
-    m_threads = new pthread_t[m_thread_number];
-    if(!m_threads){
-        throw std::exception();
-    }
-    for(uint32_t i = 0; i < thread_number; i++){
-        // 内存单元、线程熟悉(NULL)、工作函数，传递参数（线程池）
-        if(pthread_create(m_threads + i, NULL, worker,this) != 0){
-            delete[] m_threads;
-            throw std::exception();
-        }
-        //分离主线程与子线程，子线程结束后资源自动回收
-        if(pthread_detach(m_threads[i]) != 0){
-            delete[] m_threads;
-            throw std::exception();
-         }
-    }
-}
-
-// 析构，释放线程数组
-template <typename T>
-threadpool<T>::~threadpool(){
-    delete[] m_threads;
+threadpool<T>::threadpool(int actor_model, uint32_t thread_number, uint32_t max_request, int queue_mode,
+                          uint32_t max_threads, int target_wait_us, int idle_ms)
+:task_pool(thread_number, max_request, queue_mode, max_threads, target_wait_us, idle_ms),m_actor_model(actor_model),m_completion(nullptr){
 }
 
-// 添加请求，并利用信号量通知工作线程
+// 添加请求，任务只捕获两个指针，存放在任务内部不分配内存
 template <typename T>
 bool threadpool<T>::append(T *request,int state){
-    // 任务队列是临界区，加互斥锁
-    m_queuelocker.lock();
-    if(m_workqueue.size() >= m_max_request){
-        m_queuelocker.unlock();
-        return false;
-    }
-    // 加入请求队列，然后解锁
+    // 入队的release保证状态先于请求对工作线程可见
     request->m_state = state;
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    // 增加信号量，表示有任务要处理
-    m_queuestat.post();
-    return true;
+    return append_p(request);
 }
 
-// 添加请求，不带状态
+// 添加请求，不带状态；工作窃取模式下优先交给上次处理该连接的线程，其缓冲区还在那个核的缓存中
 template <typename T>
 bool threadpool<T>::append_p(T *request){
-    m_queuelocker.lock();
-    if(m_workqueue.size() >= m_max_request){
-        m_queuelocker.unlock();
+    // 计数在入队前增加，事件循环看到不为0时不会释放连接
+    request->m_busy.fetch_add(1, std::memory_order_relaxed);
+    if(!submit([this, request]{ handle(request); }, request->m_worker.load(std::memory_order_relaxed))){
+        request->m_busy.fetch_sub(1, std::memory_order_release);
         return false;
     }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
     return true;
 }
 
-// 工作线程运行
-template <typename T>
-void* threadpool<T>::worker(void *arg){
-    // 转换为线程池类
-    threadpool *pool = (threadpool *)arg;
-    pool->run();
-    return nullptr;
-}
-
-
-// 工作函数
 template <typename T>
-void threadpool<T>::run(){
-    while(true){
-        // 信号量阻塞，等待任务
-        m_queuestat.wait();
-        // 请求队列临界区，加互斥锁
-        m_queuelocker.lock();
-        if(m_workqueue.empty()){
-            m_queuelocker.unlock();
-            continue;
-        }
-        // 从请求队列取第一个请求
-        T *request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
-        if(!request)
-            continue;
-        // reactor
-        if(m_actor_model == 1){
-            // 读
-            if(request->m_state == 0){
-                if(request->read_once()){
-                    request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    request->process();
-                }
-                else{
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+void threadpool<T>::handle(T *request){
+    // 记录处理线程，该连接的下一个请求优先投递回来
+    request->m_worker.store(current_worker(), std::memory_order_relaxed);
+    // reactor
+    if(m_actor_model == 1){
+        // 读
+        if(request->m_state == 0){
+            if(request->read_once()){
+                request->process();
             }
-            // 写
             else{
-                if(request->write()){
-                    request->improv = 1;
-                }
-                else{
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                request->timer_flag.store(1, std::memory_order_relaxed);
             }
         }
-        // proactor
+        // 写
         else{
-            // 从连接池中取出一个数据库连接 RAII
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
-            // 处理请求
-            request->process();
+            if(!request->write()){
+                request->timer_flag.store(1, std::memory_order_relaxed);
+            }
+            // 读缓冲中还有流水线请求，直接在本线程继续处理
+            else if(request->has_buffered()){
+                request->process();
+            }
         }
+        // release：timer_flag及请求上的其他写入先于improv对事件循环可见
+        // improv原本为1说明上一次完成尚未被事件循环取走，请求已在完成队列中，不能重复入队
+        if(request->improv.exchange(1, std::memory_order_acq_rel) == 0 && m_completion)
+            m_completion->push(request);
+    }
+    // proactor
+    else{
+        // 处理请求
+        request->process();
     }
+    // 最后一步：release保证本任务对连接的访问先于计数归零对事件循环可见
+    request->m_busy.fetch_sub(1, std::memory_order_release);
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "thread_affinity.h"
+
+// 本线程绑核后所在的NUMA节点
+static thread_local int t_node = -1;
+
+vector<int> parse_cpu_list(const char *list){
+    vector<int> cpus;
+    if(!list)
+        return cpus;
+    const char *p = list;
+    while(*p){
+        char *end;
+        long first = strtol(p, &end, 10);
+        if(end == p || first < 0)
+            return vector<int>();
+        long last = first;
+        p = end;
+        if(*p == '-'){
+            last = strtol(p + 1, &end, 10);
+            if(end == p + 1 || last < first)
+                return vector<int>();
+            p = end;
+        }
+        for(long cpu = first; cpu <= last; ++cpu)
+            cpus.push_back((int)cpu);
+        if(*p == ',')
+            ++p;
+        else if(*p)
+            return vector<int>();
+    }
+    return cpus;
+}
+
+void set_thread_name(const char *name){
+    char buf[16];
+    strncpy(buf, name, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    pthread_setname_np(pthread_self(), buf);
+}
+
+bool pin_thread(int cpu){
+    if(cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return false;
+    t_node = cpu_node(cpu);
+    return true;
+}
+
+int cpu_node(int cpu){
+    // sysfs中cpu目录下有指向所属节点的nodeN项
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if(!dir)
+        return 0;
+    int node = 0;
+    struct dirent *ent;
+    while((ent = readdir(dir)) != nullptr){
+        if(strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9'){
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int thread_node(){
+    return t_node;
+}
+
+void* numa_alloc(size_t size, int node){
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED)
+        return nullptr;
+    // 页面在首次访问时才分配，先设置策略，之后由哪个线程写入都放在该节点上；节点内存不足时内核退回其他节点
+    if(node >= 0 && node < (int)(sizeof(unsigned long) * 8)){
+        unsigned long mask = 1UL << node;
+        syscall(SYS_mbind, addr, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+    }
+    return addr;
+}
+
+void numa_free(void *addr, size_t size){
+    if(addr)
+        munmap(addr, size);
+}
+
+void cpu_affinity::init(const char *loop_cpus, const char *worker_cpus){
+    m_loop_cpus = parse_cpu_list(loop_cpus);
+    m_worker_cpus = parse_cpu_list(worker_cpus);
+}
+
+int cpu_affinity::loop_cpu(int index) const{
+    if(m_loop_cpus.empty() || index < 0)
+        return -1;
+    return m_loop_cpus[index % m_loop_cpus.size()];
+}
+
+int cpu_affinity::worker_cpu(int index) const{
+    if(m_worker_cpus.empty() || index < 0)
+        return -1;
+    return m_worker_cpus[index % m_worker_cpus.size()];
+}
+
+int cpu_affinity::worker_node(int index) const{
+    int cpu = worker_cpu(index);
+    return cpu < 0 ? -1 : cpu_node(cpu);
+}
+
+void place_thread(const char *name, int cpu){
+    set_thread_name(name);
+    if(cpu >= 0)
+        pin_thread(cpu);
+}
@@ -0,0 +1,55 @@
+#ifndef THREAD_AFFINITY_H
+#define THREAD_AFFINITY_H
+
+#include <vector>
+#include <stddef.h>
+
+using namespace std;
+
+// 线程命名、绑核与NUMA节点就近分配，直接使用系统调用与sysfs，不依赖libnuma
+
+// 解析"0-3,8,10-11"形式的CPU列表，格式错误或为空返回空列表
+vector<int> parse_cpu_list(const char *list);
+// 设置当前线程名，超过15个字符截断，top -H与perf按名字区分线程
+void set_thread_name(const char *name);
+// 当前线程绑定到cpu，成功后记录所在NUMA节点
+bool pin_thread(int cpu);
+// cpu所在的NUMA节点，无法确定时为0
+int cpu_node(int cpu);
+// 当前线程绑定的NUMA节点，未绑核为-1
+int thread_node();
+// 按页分配内存并优先放在node上，node<0时不指定；内容为0
+void* numa_alloc(size_t size, int node);
+void numa_free(void *addr, size_t size);
+
+// 事件循环与工作线程的绑核配置，需在创建线程之前设置
+class cpu_affinity{
+public:
+    static cpu_affinity* get_instance(){
+        static cpu_affinity instance;
+        return &instance;
+    }
+
+    // 主循环使用loop_cpus的第一个，子反应堆i使用第i+1个，工作线程i使用worker_cpus的第i个，列表不够时循环使用
+    void init(const char *loop_cpus, const char *worker_cpus);
+    // 对应线程应绑定的cpu，未配置返回-1
+    int loop_cpu(int index) const;
+    int worker_cpu(int index) const;
+    // 对应cpu的NUMA节点，未配置返回-1
+    int worker_node(int index) const;
+
+private:
+    cpu_affinity(){}
+    ~cpu_affinity(){}
+    cpu_affinity(const cpu_affinity&) = delete;
+    cpu_affinity& operator=(const cpu_affinity&) = delete;
+
+private:
+    vector<int> m_loop_cpus;
+    vector<int> m_worker_cpus;
+};
+
+// 新线程的常用初始化：命名并按配置绑核，cpu<0时只命名
+void place_thread(const char *name, int cpu);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Chase-Lev工作窃取双端队列，容量固定
+// 只有所属工作线程在底部压入、弹出，其他线程从顶部窃取；所属线程的操作只在剩最后一个元素时才需要CAS
+template <typename T>
+class ws_deque{
+public:
+    // 容量向上取整为2的幂
+    explicit ws_deque(size_t capacity):m_top(0), m_bottom(0){
+        size_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_items = new std::atomic<T>[size];
+    }
+    ~ws_deque(){
+        delete[] m_items;
+    }
+
+    // 所属线程调用：压入底部，队列满返回false
+    bool push(T item){
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if(b - t > (int64_t)m_mask)
+            return false;
+        m_items[b & m_mask].store(item, std::memory_order_relaxed);
+        // release：元素先于新的底部对窃取者可见
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 所属线程调用：从底部弹出
+    bool take(T &item){
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        // 先公布底部再读顶部，与steal中的屏障配对
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if(t > b){
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = m_items[b & m_mask].load(std::memory_order_relaxed);
+        if(t == b){
+            // 最后一个元素，与窃取者竞争
+            bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程调用：从顶部窃取，队列为空或竞争失败返回false
+    bool steal(T &item){
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b)
+            return false;
+        item = m_items[t & m_mask].load(std::memory_order_relaxed);
+        return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // 元素个数，并发修改时为近似值
+    size_t size() const{
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+private:
+    ws_deque(const ws_deque&) = delete;
+    ws_deque& operator=(const ws_deque&) = delete;
+
+    static const size_t CACHE_LINE = 64;
+
+    std::atomic<T> *m_items;
+    size_t m_mask;
+    // 窃取者修改顶部，所属线程修改底部，分开放在两条缓存行
+    char m_pad0[CACHE_LINE];
+    std::atomic<int64_t> m_top;
+    char m_pad1[CACHE_LINE];
+    std::atomic<int64_t> m_bottom;
+    char m_pad2[CACHE_LINE];
+};
+
+#endif
@@ -65,29 +65,45 @@ void sort_timer_lst::del_timer(util_timer *timer){
     if(timer == nullptr){
         return ;
     }
-    if((timer == head) && (timer == tail)){
-        delete timer;
-        head = nullptr;
-        tail = nullptr;
-        return ;
-    }
-    if(timer == head){
-        head = head->next;
-        head->prev = nullptr;
-        delete timer;
-        return ;
-    }
-    if(timer == tail){
-        tail = tail->prev;
-        tail->next = nullptr;
-        delete timer;
-        return ;
-    }
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
+    remove(timer);
     delete timer;
 }
 
+// 从链表摘下定时器
+void sort_timer_lst::remove(util_timer *timer){
+    if(timer == head)
+        head = timer->next;
+    else
+        timer->prev->next = timer->next;
+    if(timer == tail)
+        tail = timer->prev;
+    else
+        timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+}
+
+// 按连接阶段计算截止时间，请求头阶段只在进入时计时，慢速发送请求头的连接不能一直占着
+// 阶段切换后截止时间可能提前，此时从链表头重新插入
+void sort_timer_lst::refresh(util_timer *timer, int phase){
+    if(timer == nullptr)
+        return;
+    if(phase == PHASE_HEADER && timer->phase == PHASE_HEADER)
+        return;
+    time_t expire = time(nullptr) + conn_timeouts[phase];
+    timer->phase = phase;
+    if(expire == timer->expire)
+        return;
+    bool earlier = expire < timer->expire;
+    timer->expire = expire;
+    if(!earlier){
+        adjust_timer(timer);
+        return;
+    }
+    remove(timer);
+    add_timer(timer);
+}
+
 // SIGALRM 信号每次被触发，主循环中调有一次定时任务处理函数，处理链表容器中到期的定时器
 void sort_timer_lst::tick(){
     if(head == nullptr){
@@ -105,7 +121,17 @@ void sort_timer_lst::tick(){
         if(head != nullptr){
             head->prev = nullptr;
         }
-        delete tmp;
+        else{
+            tail = nullptr;
+        }
+        // 回调推迟了截止时间（连接仍在工作线程中处理），重新插入，稍后再检查
+        if(tmp->expire > cur){
+            tmp->prev = tmp->next = nullptr;
+            add_timer(tmp);
+        }
+        else{
+            delete tmp;
+        }
         tmp = head;
     }
 }
@@ -126,8 +152,8 @@ void sort_timer_lst::add_timer(util_timer *timer, util_timer *lst_head){
         prev = tmp;
         tmp = tmp->next;
     }
-    // 如果找到位置，则插入；否则插入到链表尾部
-    if(tmp != nullptr){
+    // 遍历到链表尾仍未找到位置，插入到链表尾部
+    if(tmp == nullptr){
         prev->next = timer;
         timer->prev = prev;
         timer->next = nullptr;
@@ -223,17 +249,22 @@ void Utils::show_error(int connfd, const char *info){
     close(connfd);
 }
 
+int conn_timeouts[PHASE_NUM] = {15, 15, 15, 15};
+
 int *Utils::u_pipefd = 0;
 int Utils::u_epollfd = 0;
 
 // 定时器回调函数，释放客户端连接
 void cb_func(client_data *user_data){
-    // 删除非活动连接在socket上的注册事件
-    epoll_ctl(Utils::u_epollfd,EPOLL_CTL_DEL,user_data->sockfd,0);
     assert(user_data);
+    // 删除非活动连接在socket上的注册事件，多反应堆模式下连接注册在子反应堆的epoll上
+    int epollfd = user_data->epollfd >= 0 ? user_data->epollfd : Utils::u_epollfd;
+    epoll_ctl(epollfd,EPOLL_CTL_DEL,user_data->sockfd,0);
 
     // 关闭socket
     close(user_data->sockfd);
+    // 定时器随后由链表释放，置空防止连接上的后续事件再次使用
+    user_data->timer = nullptr;
 
     // 减少连接数
     
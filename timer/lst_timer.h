@@ -26,20 +26,33 @@
 // 前向声明
 class util_timer;
 
+// 连接所处阶段，各阶段的超时时长分别配置
+enum CONN_PHASE{
+    PHASE_HEADER = 0,   // 等待或读取请求头，截止时间从阶段开始计算，收到数据不延长
+    PHASE_BODY,         // 读取消息体，每次收到数据延长
+    PHASE_WRITE,        // 发送响应，每次发出数据延长
+    PHASE_IDLE,         // 长连接空闲，等待下一个请求
+    PHASE_NUM
+};
+// 各阶段的超时时长（秒），服务启动前设置
+extern int conn_timeouts[PHASE_NUM];
+
 // 客户端数据结构体
 struct client_data{
     sockaddr_in address;    //  客户端地址
     int sockfd;             // 客户socket
-    util_timer  *time;      // 定时器
+    int epollfd;            // 所属事件循环的epoll句柄
+    util_timer *timer;      // 定时器
 };
 
 
 // 定时器类
 class util_timer{
 public:
-    util_timer():prev(nullptr), next(nullptr){}
+    util_timer():phase(PHASE_HEADER), prev(nullptr), next(nullptr){}
 public: 
     time_t expire;                  // 超时时间
+    int phase;                      // 连接所处阶段
     void (*cb_func)(client_data*);  // 回调函数
     client_data *user_data;         // 连接资源
     util_timer *prev;               // 前指针
@@ -58,12 +71,14 @@ public:
     void add_timer(util_timer *timer);      // 添加定时器
     void adjust_timer(util_timer *timer);   // 调整定时器
     void del_timer(util_timer *timer);      // 删除定时器
+    void refresh(util_timer *timer, int phase); // 按连接阶段更新截止时间
     void tick();                            // 定时任务处理函数
     util_timer* get_head();
     util_timer* get_tail();
 
 private:
     void add_timer(util_timer *timer, util_timer *lst_head); // 辅助添加函数
+    void remove(util_timer *timer);         // 从链表摘下，不释放
     util_timer *head;       // 链表头
     util_timer *tail;       // 链表尾
 };
@@ -83,7 +98,7 @@ public:
     void addfd(int epollfd,int fd, bool one_shot, int TRIGMode);
     void addsig(int sig, void(*handler)(int),bool restart = true);
     void timer_handler();
-    void show_error(int connfd, const char *info);
+    static void show_error(int connfd, const char *info);
 
 public:
     static int *u_pipefd;       // 本地套接字